@@ -1,5 +1,10 @@
 #include "BaseWorld.h"
 
+BaseWorld::BaseWorld(const TaskManagerSettings& settings, std::shared_ptr<TaskExecutor> executor) :
+	taskManager(settings, executor)
+{
+}
+
 void BaseWorld::init()
 {
 	taskManager.generateDependencyGraph();
@@ -9,3 +14,8 @@ void BaseWorld::run()
 {
 	taskManager.run();
 }
+
+std::future<void> BaseWorld::runAsync()
+{
+	return taskManager.runAsync();
+}
@@ -2,12 +2,21 @@
 
 #include "TaskManager.h"
 
+#include <future>
+#include <memory>
+
 class BaseWorld
 {
 public:
+	// Worlds share the process-wide executor by default, so that running several of them doesn't multiply the threads.
+	BaseWorld(const TaskManagerSettings& settings = TaskManagerSettings(), std::shared_ptr<TaskExecutor> executor = TaskExecutor::getShared());
+
 	void init();
 	void run();
 
+	// Starts a tick without waiting for it, see TaskManager::runAsync().
+	std::future<void> runAsync();
+
 protected:
 	TaskManager taskManager;
 };
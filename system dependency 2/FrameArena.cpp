@@ -0,0 +1,45 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+
+FrameArena::FrameArena(std::size_t blockSize) :
+	blockSize(blockSize)
+{
+}
+
+std::size_t FrameArena::reset()
+{
+	const std::size_t usedBytes = getUsedBytes();
+
+	// Replacing the blocks with a single one as big as all of them.
+	if (blocks.size() > 1)
+	{
+		blocks.clear();
+		blocks.emplace_back(new unsigned char[capacity]);
+	}
+
+	if (!blocks.empty())
+	{
+		blockStart = reinterpret_cast<std::uintptr_t>(blocks.front().get());
+		current = blockStart;
+		end = blockStart + capacity;
+	}
+	usedBytesInFullBlocks = 0;
+
+	return usedBytes;
+}
+
+void* FrameArena::allocateFromNewBlock(std::size_t size, std::size_t alignment)
+{
+	// The start of the block might not be aligned enough, so there has to be room to move forward.
+	const std::size_t newBlockSize = std::max(blockSize, size + alignment - 1);
+	blocks.emplace_back(new unsigned char[newBlockSize]);
+	capacity += newBlockSize;
+
+	usedBytesInFullBlocks += current - blockStart;
+	blockStart = reinterpret_cast<std::uintptr_t>(blocks.back().get());
+	current = blockStart;
+	end = blockStart + newBlockSize;
+
+	return allocate(size, alignment);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The size of the first block of a FrameArena, unless told otherwise.
+#define DEFAULT_FRAME_ARENA_SIZE (64 * 1024)
+
+// Hands out scratch memory by moving a pointer forward, and takes all of it back at once with reset().
+// Only one thread may use an arena at a time. Nothing allocated from it gets destroyed, so it's meant
+// for trivially destructible data. When a block runs out another one is added, and on the next reset
+// the blocks get merged into one that fits them all, so that the following frames don't allocate at all.
+class alignas(64) FrameArena
+{
+public:
+	explicit FrameArena(std::size_t blockSize = DEFAULT_FRAME_ARENA_SIZE);
+
+	// The alignment must be a power of two.
+	void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+	{
+		const std::uintptr_t start = (current + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+		if (start < current || start > end || size > end - start) return allocateFromNewBlock(size, alignment);
+
+		current = start + size;
+		return reinterpret_cast<void*>(start);
+	}
+
+	// Room for count objects of type T, which are left uninitialized.
+	template<class T>
+	T* allocate(std::size_t count = 1)
+	{
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// Takes back everything that was allocated, and returns how many bytes that was.
+	std::size_t reset();
+
+	// The bytes allocated since the last reset, counting the padding.
+	std::size_t getUsedBytes() const { return usedBytesInFullBlocks + (current - blockStart); }
+
+private:
+	void* allocateFromNewBlock(std::size_t size, std::size_t alignment);
+
+	std::size_t blockSize;
+	std::vector<std::unique_ptr<unsigned char[]>> blocks;
+	std::size_t capacity = 0;
+
+	// The free part of the current block.
+	std::uintptr_t blockStart = 0;
+	std::uintptr_t current = 0;
+	std::uintptr_t end = 0;
+
+	// What the previous blocks were filled up to when they ran out.
+	std::size_t usedBytesInFullBlocks = 0;
+};
+
+// Lets standard containers take their memory from a FrameArena, for scratch data that lives until the end of the frame.
+// Deallocating does nothing, the memory comes back when the arena is reset.
+template<class T>
+class FrameAllocator
+{
+public:
+	using value_type = T;
+
+	explicit FrameAllocator(FrameArena& arena) : arena(&arena) {}
+
+	template<class U>
+	FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(std::size_t count) { return arena->allocate<T>(count); }
+	void deallocate(T*, std::size_t) {}
+
+	template<class U>
+	bool operator==(const FrameAllocator<U>& other) const { return arena == other.arena; }
+	template<class U>
+	bool operator!=(const FrameAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+	template<class U>
+	friend class FrameAllocator;
+
+	FrameArena* arena;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Bytes available to store the callable inside an InlineFunction, so that the whole object takes one cache line.
+#define INLINE_FUNCTION_SIZE 48
+
+template<class Signature>
+class InlineFunction;
+
+// Works like std::function, but the callable is always stored inside the object instead of on the heap,
+// and it's called through a plain function pointer. Callables bigger than INLINE_FUNCTION_SIZE don't compile,
+// they should capture a pointer to their data instead.
+template<class Result, class... Arguments>
+class InlineFunction<Result(Arguments...)>
+{
+public:
+	InlineFunction() = default;
+	InlineFunction(std::nullptr_t) {}
+
+	template<class Callable, class = typename std::enable_if<!std::is_same<typename std::decay<Callable>::type, InlineFunction>::value>::type>
+	InlineFunction(Callable&& callable)
+	{
+		using StoredCallable = typename std::decay<Callable>::type;
+		static_assert(sizeof(StoredCallable) <= INLINE_FUNCTION_SIZE, "The callable is too big to be stored inline, capture a pointer to its data instead.");
+		static_assert(alignof(StoredCallable) <= alignof(std::max_align_t), "The callable needs more alignment than an InlineFunction has.");
+
+		new (storage) StoredCallable(std::forward<Callable>(callable));
+		invoker = &invoke<StoredCallable>;
+		manager = &manage<StoredCallable>;
+	}
+
+	InlineFunction(const InlineFunction& other)
+	{
+		copyFrom(other);
+	}
+
+	InlineFunction(InlineFunction&& other)
+	{
+		moveFrom(other);
+	}
+
+	~InlineFunction()
+	{
+		reset();
+	}
+
+	InlineFunction& operator=(const InlineFunction& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			copyFrom(other);
+		}
+		return *this;
+	}
+
+	InlineFunction& operator=(InlineFunction&& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			moveFrom(other);
+		}
+		return *this;
+	}
+
+	InlineFunction& operator=(std::nullptr_t)
+	{
+		reset();
+		return *this;
+	}
+
+	explicit operator bool() const { return invoker != nullptr; }
+
+	Result operator()(Arguments... arguments) const
+	{
+		return invoker(const_cast<unsigned char*>(storage), std::forward<Arguments>(arguments)...);
+	}
+
+private:
+	enum class Operation
+	{
+		Copy,
+		Move,
+		Destroy
+	};
+
+	template<class StoredCallable>
+	static Result invoke(void* callable, Arguments... arguments)
+	{
+		return (*static_cast<StoredCallable*>(callable))(std::forward<Arguments>(arguments)...);
+	}
+
+	// Only used when copying, moving or destroying, so that calling doesn't need to go through it.
+	template<class StoredCallable>
+	static void manage(Operation operation, void* destination, void* source)
+	{
+		switch (operation)
+		{
+		case Operation::Copy:
+			new (destination) StoredCallable(*static_cast<const StoredCallable*>(source));
+			break;
+		case Operation::Move:
+			new (destination) StoredCallable(std::move(*static_cast<StoredCallable*>(source)));
+			break;
+		case Operation::Destroy:
+			static_cast<StoredCallable*>(destination)->~StoredCallable();
+			break;
+		}
+	}
+
+	void copyFrom(const InlineFunction& other)
+	{
+		if (!other.invoker) return;
+		other.manager(Operation::Copy, storage, const_cast<unsigned char*>(other.storage));
+		invoker = other.invoker;
+		manager = other.manager;
+	}
+
+	void moveFrom(InlineFunction& other)
+	{
+		if (!other.invoker) return;
+		other.manager(Operation::Move, storage, other.storage);
+		invoker = other.invoker;
+		manager = other.manager;
+		other.reset();
+	}
+
+	void reset()
+	{
+		if (!invoker) return;
+		manager(Operation::Destroy, storage, nullptr);
+		invoker = nullptr;
+		manager = nullptr;
+	}
+
+	alignas(std::max_align_t) unsigned char storage[INLINE_FUNCTION_SIZE];
+	Result (*invoker)(void*, Arguments...) = nullptr;
+	void (*manager)(Operation, void*, void*) = nullptr;
+};
@@ -38,15 +38,29 @@ void PrototypeGameWorld::init()
 		std::cout << "Running system 5! Destroying a planet!" << std::endl;
 		planetsDestroyed++;
 	};
+	system5.writtenResources = { "planetsDestroyed" };
 	taskManager.addTask(system5);
 
-	// A system that reads said variable.
+	// A system that reads said variable, it gets to run after system 5 without having to name it.
 	TaskInformation system6;
 	system6.name = "system6";
 	system6.task = [&]() { std::cout << "Running system 6! There are " << planetsDestroyed << " destroyed planets!" << std::endl;};
-	system6.precedingTasks = { "system5" };
+	system6.readResources = { "planetsDestroyed" };
 	taskManager.addTask(system6);
 
+	// A data-parallel system, its range gets split among the threads. The microbes can come and go,
+	// so the end of the range is read again in every tick.
+	TaskInformation system7;
+	system7.name = "system7";
+	system7.rangeTask = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++) microbePositions[i] += 0.5f;
+	};
+	system7.getRangeEnd = [&]() { return static_cast<unsigned int>(microbePositions.size()); };
+	system7.grainSize = 256;
+	system7.writtenResources = { "microbePositions" };
+	taskManager.addTask(system7);
+
 	// Calling the parent world to add the systems it might need.
 	BaseWorld::init();
 }
@@ -2,6 +2,8 @@
 
 #include "BaseWorld.h"
 
+#include <vector>
+
 class PrototypeGameWorld : public BaseWorld
 {
 public:
@@ -9,4 +11,5 @@ public:
 
 private:
 	unsigned int planetsDestroyed = 0;
+	std::vector<float> microbePositions = std::vector<float>(1000, 0.0f);
 };
@@ -1,36 +1,199 @@
 #include "TaskDependencyGraph.h"
 
-void TaskDependencyGraph::init(std::vector<std::vector<unsigned int>> taskInformation)
+#include <algorithm>
+
+void TaskDependencyGraph::init(const std::vector<unsigned int>& precedingTaskOffsets, const std::vector<unsigned int>& precedingTasks,
+	unsigned int numberOfSlots, const std::vector<unsigned int>& nextTickTaskOffsets, const std::vector<unsigned int>& nextTickTasks)
 {
-	nodes = std::vector<Node>(taskInformation.size(), Node());
+	const unsigned int numberOfTasks = static_cast<unsigned int>(precedingTaskOffsets.size()) - 1;
+	nodes = std::vector<Node>(numberOfTasks);
+	this->numberOfSlots = numberOfSlots;
+	this->precedingTaskOffsets = precedingTaskOffsets;
+	this->precedingTasks = precedingTasks;
+	this->nextTickTaskOffsets = nextTickTaskOffsets;
+	this->nextTickTasks = nextTickTasks;
+
+	// Counting the edges in each direction.
+	for (unsigned int i = 0; i < numberOfTasks; i++)
+	{
+		for (unsigned int j = precedingTaskOffsets[i]; j < precedingTaskOffsets[i + 1]; j++) nodes[precedingTasks[j]].numberOfDependantTasks++;
+	}
 
-	for(unsigned int i = 0; i < taskInformation.size(); i++)
+	// Laying out the dependants of every task one after the other.
+	unsigned int offset = 0;
+	for (auto& node : nodes)
 	{
-		for (unsigned int preceedingNode : taskInformation[i])
+		node.firstDependantTask = offset;
+		offset += node.numberOfDependantTasks;
+		node.numberOfDependantTasks = 0;
+	}
+
+	dependantTasks.assign(offset, 0);
+	for (unsigned int i = 0; i < numberOfTasks; i++)
+	{
+		for (unsigned int j = precedingTaskOffsets[i]; j < precedingTaskOffsets[i + 1]; j++)
 		{
-			nodes[i].numberOfprecedingTasks++;
-			nodes[preceedingNode].dependantTasksIndex.push_back(i);
+			Node& precedingTask = nodes[precedingTasks[j]];
+			dependantTasks[precedingTask.firstDependantTask + precedingTask.numberOfDependantTasks++] = i;
 		}
 	}
+
+	// When ticks overlap, a task also waits for itself and for the tasks that hold it back in the previous tick.
+	for (unsigned int i = 0; i < numberOfTasks; i++) nodes[i].numberOfprecedingTasks = firstTickCount(i) + (numberOfSlots > 1);
+	if (numberOfSlots > 1) for (unsigned int task : nextTickTasks) nodes[task].numberOfprecedingTasks++;
+
+	counters = std::vector<Counter>(numberOfSlots * numberOfTasks);
+	restart(0);
 }
 
-std::vector<unsigned int> TaskDependencyGraph::finishTask(unsigned int finishedTaskIndex)
+void TaskDependencyGraph::restart(unsigned int firstSlot)
 {
-	std::vector<unsigned int> result;
-	std::lock_guard<std::mutex> lg(lock);
+	// The first tick doesn't have a previous one to wait for.
+	const unsigned int numberOfTasks = static_cast<unsigned int>(nodes.size());
+	for (unsigned int slot = 0; slot < numberOfSlots; slot++)
+	{
+		for (unsigned int i = 0; i < numberOfTasks; i++)
+		{
+			const unsigned int count = slot == firstSlot ? firstTickCount(i) : nodes[i].numberOfprecedingTasks;
+			counters[slot * numberOfTasks + i].numberOfprecedingTasksRemaining.store(count, std::memory_order_relaxed);
+		}
+	}
+}
 
-	for(unsigned int dependantTaskIndex : nodes[finishedTaskIndex].dependantTasksIndex)
+std::vector<unsigned int> TaskDependencyGraph::findCycle() const
+{
+	const unsigned int numberOfTasks = static_cast<unsigned int>(nodes.size());
+
+	// Running the graph with Kahn's algorithm, anything that never becomes ready is in a cycle or waits for one.
+	std::vector<unsigned int> remaining(numberOfTasks);
+	std::vector<unsigned int> readyTasks;
+	for (unsigned int i = 0; i < numberOfTasks; i++)
+	{
+		remaining[i] = precedingTaskOffsets[i + 1] - precedingTaskOffsets[i];
+		if (remaining[i] == 0) readyTasks.push_back(i);
+	}
+
+	while (!readyTasks.empty())
+	{
+		const Node& node = nodes[readyTasks.back()];
+		readyTasks.pop_back();
+		for (unsigned int j = node.firstDependantTask; j < node.firstDependantTask + node.numberOfDependantTasks; j++)
+		{
+			if (--remaining[dependantTasks[j]] == 0) readyTasks.push_back(dependantTasks[j]);
+		}
+	}
+
+	const auto blockedTask = std::find_if(remaining.begin(), remaining.end(), [](unsigned int count) { return count > 0; });
+	if (blockedTask == remaining.end()) return {};
+
+	// Every blocked task waits for at least one blocked task, so walking backwards must end up going in circles.
+	std::vector<unsigned int> visitOrder(numberOfTasks, 0);
+	std::vector<unsigned int> path;
+	unsigned int task = static_cast<unsigned int>(blockedTask - remaining.begin());
+	while (visitOrder[task] == 0)
 	{
-		nodes[dependantTaskIndex].numberOfprecedingTasksCompleted++;
-		if (nodes[dependantTaskIndex].numberOfprecedingTasksCompleted == nodes[dependantTaskIndex].numberOfprecedingTasks)
-			result.push_back(dependantTaskIndex);
+		path.push_back(task);
+		visitOrder[task] = static_cast<unsigned int>(path.size());
+		for (unsigned int j = precedingTaskOffsets[task]; j < precedingTaskOffsets[task + 1]; j++)
+		{
+			if (remaining[precedingTasks[j]] > 0)
+			{
+				task = precedingTasks[j];
+				break;
+			}
+		}
 	}
 
-	return result;
+	std::vector<unsigned int> cycle(path.begin() + (visitOrder[task] - 1), path.end());
+	std::reverse(cycle.begin(), cycle.end());
+	return cycle;
 }
 
-void TaskDependencyGraph::reset()
+std::vector<float> TaskDependencyGraph::computeRanks(const std::vector<float>& costs) const
 {
-	std::lock_guard<std::mutex> lg(lock);
-	for (auto& node : nodes) node.numberOfprecedingTasksCompleted = 0;
+	const unsigned int numberOfTasks = static_cast<unsigned int>(nodes.size());
+
+	// Going from the tasks nothing waits for back to the first ones, so every dependant is ranked before its preceding tasks.
+	std::vector<float> ranks(costs);
+	std::vector<unsigned int> remaining(numberOfTasks);
+	std::vector<unsigned int> rankedTasks;
+	for (unsigned int i = 0; i < numberOfTasks; i++)
+	{
+		remaining[i] = nodes[i].numberOfDependantTasks;
+		if (remaining[i] == 0) rankedTasks.push_back(i);
+	}
+
+	while (!rankedTasks.empty())
+	{
+		const unsigned int task = rankedTasks.back();
+		rankedTasks.pop_back();
+		for (unsigned int j = precedingTaskOffsets[task]; j < precedingTaskOffsets[task + 1]; j++)
+		{
+			const unsigned int precedingTask = precedingTasks[j];
+			ranks[precedingTask] = std::max(ranks[precedingTask], costs[precedingTask] + ranks[task]);
+			if (--remaining[precedingTask] == 0) rankedTasks.push_back(precedingTask);
+		}
+	}
+
+	return ranks;
+}
+
+std::vector<std::vector<unsigned int>> TaskDependencyGraph::computeListSchedule(const std::vector<float>& costs, unsigned int numberOfWorkers) const
+{
+	const unsigned int numberOfTasks = static_cast<unsigned int>(nodes.size());
+	const std::vector<float> ranks = computeRanks(costs);
+
+	// The ready tasks are kept in a heap, highest rank first.
+	const auto isLessUrgent = [&](unsigned int a, unsigned int b) { return ranks[a] != ranks[b] ? ranks[a] < ranks[b] : a > b; };
+	std::vector<unsigned int> remaining(numberOfTasks);
+	std::vector<unsigned int> readyTasks;
+	for (unsigned int i = 0; i < numberOfTasks; i++)
+	{
+		remaining[i] = precedingTaskOffsets[i + 1] - precedingTaskOffsets[i];
+		if (remaining[i] == 0) readyTasks.push_back(i);
+	}
+	std::make_heap(readyTasks.begin(), readyTasks.end(), isLessUrgent);
+
+	std::vector<std::vector<unsigned int>> schedule(numberOfWorkers);
+	std::vector<float> workerFreeTimes(numberOfWorkers, 0.0f);
+	std::vector<float> finishTimes(numberOfTasks, 0.0f);
+	std::vector<unsigned int> taskWorkers(numberOfTasks, 0);
+	while (!readyTasks.empty())
+	{
+		std::pop_heap(readyTasks.begin(), readyTasks.end(), isLessUrgent);
+		const unsigned int task = readyTasks.back();
+		readyTasks.pop_back();
+
+		// Staying on the worker of the preceding task that finishes last when it's as good, since its data is there.
+		float readyTime = 0.0f;
+		unsigned int worker = 0;
+		for (unsigned int j = precedingTaskOffsets[task]; j < precedingTaskOffsets[task + 1]; j++)
+		{
+			const unsigned int precedingTask = precedingTasks[j];
+			if (finishTimes[precedingTask] < readyTime) continue;
+
+			readyTime = finishTimes[precedingTask];
+			worker = taskWorkers[precedingTask];
+		}
+		for (unsigned int i = 0; i < numberOfWorkers; i++)
+		{
+			if (std::max(workerFreeTimes[i], readyTime) < std::max(workerFreeTimes[worker], readyTime)) worker = i;
+		}
+
+		schedule[worker].push_back(task);
+		taskWorkers[task] = worker;
+		finishTimes[task] = std::max(workerFreeTimes[worker], readyTime) + costs[task];
+		workerFreeTimes[worker] = finishTimes[task];
+
+		const Node& node = nodes[task];
+		for (unsigned int j = node.firstDependantTask; j < node.firstDependantTask + node.numberOfDependantTasks; j++)
+		{
+			if (--remaining[dependantTasks[j]] > 0) continue;
+
+			readyTasks.push_back(dependantTasks[j]);
+			std::push_heap(readyTasks.begin(), readyTasks.end(), isLessUrgent);
+		}
+	}
+
+	return schedule;
 }
@@ -1,31 +1,131 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
-#include <mutex>
 
+// Keeps track of which tasks can run. Several ticks can be in flight at once, each one using
+// its own slot of counters, so that the next tick can start before the previous one is over.
 class TaskDependencyGraph
 {
 public:
-	// This receives a vector of vectors, where the n-th vector has all the tasks that must be completed before
-	// the n-th task can run.
-	void init(std::vector<std::vector<unsigned int>> taskInformation);
+	// Receives the graph in compressed sparse row form: the tasks that must be completed before the n-th task
+	// can run are precedingTasks[precedingTaskOffsets[n]] up to precedingTasks[precedingTaskOffsets[n + 1]].
+	// With more than one slot, every task also waits for itself in the previous tick, and the n-th task
+	// holds back nextTickTasks[nextTickTaskOffsets[n]] up to nextTickTasks[nextTickTaskOffsets[n + 1]]
+	// of the following tick until it's done.
+	void init(const std::vector<unsigned int>& precedingTaskOffsets, const std::vector<unsigned int>& precedingTasks,
+		unsigned int numberOfSlots, const std::vector<unsigned int>& nextTickTaskOffsets, const std::vector<unsigned int>& nextTickTasks);
 
-	// Reports the finalization of a task to the graph.
-	// Returns a vector with the tasks that were unlocked by it.
-	std::vector<unsigned int> finishTask(unsigned int finishedTaskIndex);
+	// Rearms the counters of every slot so that the next tick, which goes in the given slot, doesn't wait for a previous one.
+	// Must only be called when no tick is in flight.
+	void restart(unsigned int firstSlot);
 
-	// Sets all the tasks as unfinished.
-	void reset();
+	// Returns the tasks of a dependency cycle in running order (each one waits for the previous one,
+	// and the first one waits for the last one), or nothing if the graph can be run.
+	std::vector<unsigned int> findCycle() const;
+
+	// Returns the upward rank of every task: its own cost plus the most expensive chain of dependants after it
+	// within a tick, so the tasks on the critical path get the highest ranks. The graph must not have cycles.
+	std::vector<float> computeRanks(const std::vector<float>& costs) const;
+
+	// Plans a tick ahead of time: returns the tasks every worker should run, in order, so that the tick ends as soon
+	// as possible if every task takes its cost. Tasks are placed by decreasing rank, each one on the worker where it
+	// can start first. The graph must not have cycles.
+	std::vector<std::vector<unsigned int>> computeListSchedule(const std::vector<float>& costs, unsigned int numberOfWorkers) const;
+
+	// Returns true if every task that a task waits for within a tick passes the check.
+	template<class Predicate>
+	bool allPrecedingTasks(unsigned int taskIndex, Predicate&& predicate) const
+	{
+		for (unsigned int i = precedingTaskOffsets[taskIndex]; i < precedingTaskOffsets[taskIndex + 1]; i++)
+		{
+			if (!predicate(precedingTasks[i])) return false;
+		}
+		return true;
+	}
+
+	// Calls callback(taskIndex) for every task that waits for a task within a tick.
+	template<class Callback>
+	void forEachDependantTask(unsigned int taskIndex, Callback&& callback) const
+	{
+		const Node& node = nodes[taskIndex];
+		for (unsigned int i = node.firstDependantTask; i < node.firstDependantTask + node.numberOfDependantTasks; i++) callback(dependantTasks[i]);
+	}
+
+	// Tasks that don't depend on anything have to be started for every tick.
+	// Calls onUnlocked(taskIndex, slot) if the task can run.
+	template<class Callback>
+	void startTask(unsigned int taskIndex, unsigned int slot, Callback&& onUnlocked)
+	{
+		releaseTask(taskIndex, slot, onUnlocked);
+	}
+
+	// Reports the finalization of a task in a slot to the graph.
+	// Calls onUnlocked(taskIndex, slot) for every task that was unlocked by it, without locking or allocating.
+	template<class Callback>
+	void finishTask(unsigned int finishedTaskIndex, unsigned int slot, Callback&& onUnlocked)
+	{
+		const Node& finishedTask = nodes[finishedTaskIndex];
+		const unsigned int* dependantTaskIndex = dependantTasks.data() + finishedTask.firstDependantTask;
+		const unsigned int* lastDependantTaskIndex = dependantTaskIndex + finishedTask.numberOfDependantTasks;
+		for (; dependantTaskIndex != lastDependantTaskIndex; dependantTaskIndex++) releaseTask(*dependantTaskIndex, slot, onUnlocked);
+
+		if (numberOfSlots == 1) return;
+
+		// Letting the next tick run this task again, and the tasks that were waiting for it.
+		const unsigned int nextSlot = slot + 1 == numberOfSlots ? 0 : slot + 1;
+		releaseTask(finishedTaskIndex, nextSlot, onUnlocked);
+
+		const unsigned int* nextTickTaskIndex = nextTickTasks.data() + nextTickTaskOffsets[finishedTaskIndex];
+		const unsigned int* lastNextTickTaskIndex = nextTickTasks.data() + nextTickTaskOffsets[finishedTaskIndex + 1];
+		for (; nextTickTaskIndex != lastNextTickTaskIndex; nextTickTaskIndex++) releaseTask(*nextTickTaskIndex, nextSlot, onUnlocked);
+	}
 
 private:
+	// Tasks that don't depend on anything wait to be started instead.
+	unsigned int firstTickCount(unsigned int taskIndex) const { return std::max(precedingTaskOffsets[taskIndex + 1] - precedingTaskOffsets[taskIndex], 1u); }
+
+	template<class Callback>
+	void releaseTask(unsigned int taskIndex, unsigned int slot, Callback& onUnlocked)
+	{
+		std::atomic<unsigned int>& remaining = counters[slot * nodes.size() + taskIndex].numberOfprecedingTasksRemaining;
+
+		// Only the last preceding task to finish sees the counter reach zero.
+		if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			// Nothing else can touch this counter until the slot is used by another tick, so it can already be rearmed.
+			remaining.store(nodes[taskIndex].numberOfprecedingTasks, std::memory_order_relaxed);
+			onUnlocked(taskIndex, slot);
+		}
+	}
+
 	struct Node
 	{
-		unsigned int numberOfprecedingTasks;
-		unsigned int numberOfprecedingTasksCompleted = 0;
-		std::vector<unsigned int> dependantTasksIndex;
+		// The counters get rearmed to this, it includes the previous tick when ticks overlap.
+		unsigned int numberOfprecedingTasks = 0;
+
+		// Range of this task's dependants inside dependantTasks.
+		unsigned int firstDependantTask = 0;
+		unsigned int numberOfDependantTasks = 0;
+	};
+
+	// Cache line sized so that threads finishing different tasks don't fight over the same line.
+	struct alignas(64) Counter
+	{
+		std::atomic<unsigned int> numberOfprecedingTasksRemaining{ 0 };
 	};
 
 	std::vector<Node> nodes;
+	unsigned int numberOfSlots = 1;
+
+	// One counter per task for every slot, slot after slot.
+	std::vector<Counter> counters;
 
-	std::mutex lock; //You can probably replace this with atomics if you want to lose your sanity.
+	// Both directions of the graph, in compressed sparse row form.
+	std::vector<unsigned int> dependantTasks;
+	std::vector<unsigned int> precedingTaskOffsets;
+	std::vector<unsigned int> precedingTasks;
+	std::vector<unsigned int> nextTickTaskOffsets;
+	std::vector<unsigned int> nextTickTasks;
 };
@@ -0,0 +1,123 @@
+#include "TaskExecutor.h"
+#include "TaskManager.h"
+
+#include <stdexcept>
+
+namespace
+{
+	std::mutex sharedExecutorLock;
+	std::shared_ptr<TaskExecutor> sharedExecutor;
+	TaskExecutorSettings sharedExecutorSettings;
+}
+
+TaskExecutor::TaskExecutor(const TaskExecutorSettings& settings) :
+	settings(settings),
+	numberOfPoolThreads(settings.numberOfThreads > 0 ? settings.numberOfThreads - 1 : 0),
+	taskManagers(new std::atomic<TaskManager*>[MAX_TASK_MANAGERS]),
+	workerStates(new WorkerState[getNumberOfWorkers()])
+{
+	if (settings.numberOfThreads == 0) throw std::invalid_argument("The number of threads can't be 0.");
+
+	for (unsigned int i = 0; i < MAX_TASK_MANAGERS; i++) taskManagers[i].store(nullptr, std::memory_order_relaxed);
+	for (unsigned int i = getNumberOfWorkers(); i > numberOfPoolThreads; i--) freeHelperIndices.push_back(i - 1);
+
+	if (settings.fairScheduling) taskQueue.reset(new FairMailbox(MAX_TASK_MANAGERS, getNumberOfWorkers(), settings.spinIterations));
+	else if (settings.schedulingMode == SchedulingMode::WorkStealing) taskQueue.reset(new WorkStealingQueue(getNumberOfWorkers(), settings.spinIterations));
+	else if (settings.schedulingMode == SchedulingMode::CriticalPath) taskQueue.reset(new PriorityMailbox(getNumberOfWorkers(), settings.spinIterations));
+	else taskQueue.reset(new Mailbox(getNumberOfWorkers(), settings.spinIterations));
+
+	for (unsigned int i = 0; i < numberOfPoolThreads; i++) {
+		threadPool.emplace_back([this, i]()
+		{
+			std::uint64_t queueEntry;
+			while (taskQueue->pop(i, queueEntry, beingDestroyed)) runTask(i, queueEntry);
+		});
+	}
+}
+
+TaskExecutor::~TaskExecutor()
+{
+	beingDestroyed = true;
+	taskQueue->wakeAll();
+	for (auto& thr : threadPool) thr.join();
+}
+
+void TaskExecutor::runTask(unsigned int workerIndex, std::uint64_t queueEntry)
+{
+	const unsigned int taskManagerIndex = static_cast<unsigned int>(queueEntry >> 32);
+	std::atomic<unsigned int>& runningTaskManager = workerStates[workerIndex].taskManagerIndex;
+
+	// The last task of a tick can finish while the others are still releasing the next tick's tasks,
+	// so the TaskManager has to know when we are really done with it.
+	runningTaskManager.store(taskManagerIndex, std::memory_order_relaxed);
+	taskManagers[taskManagerIndex].load(std::memory_order_acquire)->runTask(workerIndex, static_cast<unsigned int>(queueEntry));
+	runningTaskManager.store(MAX_TASK_MANAGERS, std::memory_order_release);
+}
+
+std::vector<IdleStatistics> TaskExecutor::getIdleStatistics() const
+{
+	std::vector<IdleStatistics> idleStatistics;
+	for (unsigned int i = 0; i < getNumberOfWorkers(); i++) idleStatistics.push_back(taskQueue->getIdleStatistics(i));
+	return idleStatistics;
+}
+
+void TaskExecutor::configureShared(const TaskExecutorSettings& settings)
+{
+	std::lock_guard<std::mutex> lg(sharedExecutorLock);
+	if (sharedExecutor) throw std::logic_error("The shared executor was already created.");
+	sharedExecutorSettings = settings;
+}
+
+std::shared_ptr<TaskExecutor> TaskExecutor::getShared()
+{
+	std::lock_guard<std::mutex> lg(sharedExecutorLock);
+	if (!sharedExecutor) sharedExecutor = std::make_shared<TaskExecutor>(sharedExecutorSettings);
+	return sharedExecutor;
+}
+
+unsigned int TaskExecutor::registerTaskManager(TaskManager* taskManager)
+{
+	std::lock_guard<std::mutex> lg(lock);
+	for (unsigned int i = 0; i < MAX_TASK_MANAGERS; i++)
+	{
+		if (taskManagers[i].load(std::memory_order_relaxed)) continue;
+
+		taskManagers[i].store(taskManager, std::memory_order_release);
+		return i;
+	}
+
+	throw std::logic_error("An executor can't run more than " + std::to_string(MAX_TASK_MANAGERS) + " task managers.");
+}
+
+void TaskExecutor::unregisterTaskManager(unsigned int taskManagerIndex)
+{
+	waitForWorkers(taskManagerIndex);
+
+	std::lock_guard<std::mutex> lg(lock);
+	taskManagers[taskManagerIndex].store(nullptr, std::memory_order_relaxed);
+}
+
+void TaskExecutor::waitForWorkers(unsigned int taskManagerIndex) const
+{
+	// Nothing new can start, this only waits for the bookkeeping after the tasks.
+	for (unsigned int i = 0; i < getNumberOfWorkers(); i++)
+	{
+		while (workerStates[i].taskManagerIndex.load(std::memory_order_acquire) == taskManagerIndex) std::this_thread::yield();
+	}
+}
+
+unsigned int TaskExecutor::acquireHelperIndex()
+{
+	std::lock_guard<std::mutex> lg(lock);
+	if (freeHelperIndices.empty()) return EXTERNAL_WORKER_INDEX;
+
+	const unsigned int workerIndex = freeHelperIndices.back();
+	freeHelperIndices.pop_back();
+	return workerIndex;
+}
+
+void TaskExecutor::releaseHelperIndex(unsigned int workerIndex)
+{
+	std::lock_guard<std::mutex> lg(lock);
+	freeHelperIndices.push_back(workerIndex);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "TaskQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The most TaskManagers that can use the same executor at once.
+#define MAX_TASK_MANAGERS 64
+
+// The most threads that can run tasks from TaskManager::run() at the same time, besides the pool.
+#define MAX_HELPING_THREADS 4
+
+// How many times a worker that ran out of tasks checks for more by default, before it parks.
+#define DEFAULT_SPIN_ITERATIONS 1000
+
+// The default number of threads running tasks, one per core, or one when the number of cores isn't known.
+const unsigned int NUMBER_OF_THREADS = std::max(std::thread::hardware_concurrency(), 1u);
+
+class TaskManager;
+
+// How the tasks that are ready to run get distributed among the threads.
+enum class SchedulingMode
+{
+	// Every thread pops from a single queue guarded by a mutex.
+	Mailbox,
+
+	// Every thread owns a deque where it pushes the tasks it unlocks, and steals from the others when it runs out.
+	WorkStealing,
+
+	// Every thread pops from a single queue, which hands out first the ready task with the most
+	// expensive chain of tasks still waiting behind it, so the tick ends as soon as possible.
+	CriticalPath
+};
+
+struct TaskExecutorSettings
+{
+	SchedulingMode schedulingMode = SchedulingMode::Mailbox;
+
+	// How many threads run tasks, counting one thread calling TaskManager::run(). The pool gets one thread less.
+	// With a single thread there's no pool, and TaskManager::run() and TaskManager::runAsync() run the whole tick
+	// on the calling thread.
+	unsigned int numberOfThreads = NUMBER_OF_THREADS;
+
+	// Spinning a little avoids parking and waking up the workers between tasks that come in quick succession,
+	// but burns the core in the meantime. 0 parks right away.
+	unsigned int spinIterations = DEFAULT_SPIN_ITERATIONS;
+
+	// Takes turns among the TaskManagers that have ready tasks, so that a busy one can't starve the others.
+	// This uses a single shared queue, whatever the scheduling mode.
+	bool fairScheduling = false;
+};
+
+// The threads and the queue that run the tasks of one or more TaskManagers.
+class TaskExecutor
+{
+public:
+	// Starts the threads.
+	// Throws std::invalid_argument if the number of threads is 0.
+	explicit TaskExecutor(const TaskExecutorSettings& settings = TaskExecutorSettings());
+
+	// Joins all the threads, the TaskManagers using it must be gone.
+	~TaskExecutor();
+
+	// Sets up the executor shared by the whole process, before anything uses it.
+	// Throws std::logic_error if the shared executor already exists.
+	static void configureShared(const TaskExecutorSettings& settings);
+
+	// Returns the executor shared by the whole process, creating it the first time.
+	static std::shared_ptr<TaskExecutor> getShared();
+
+	// How many threads are meant to run tasks at the same time, counting one thread calling TaskManager::run().
+	unsigned int getNumberOfThreads() const { return numberOfPoolThreads + 1; }
+
+	// The pool threads, followed by the indices lent to the threads that help from TaskManager::run().
+	unsigned int getNumberOfWorkers() const { return numberOfPoolThreads + MAX_HELPING_THREADS; }
+
+	TaskQueue& getTaskQueue() { return *taskQueue; }
+
+	// How long every worker waited for tasks since the executor started, indexed like the workers.
+	std::vector<IdleStatistics> getIdleStatistics() const;
+
+	// Runs a task popped from the queue, whichever TaskManager it belongs to.
+	void runTask(unsigned int workerIndex, std::uint64_t queueEntry);
+
+	// Makes the executor run the tasks of a TaskManager. Returns the index it goes by in the queue entries.
+	// Throws std::logic_error if there are already MAX_TASK_MANAGERS.
+	unsigned int registerTaskManager(TaskManager* taskManager);
+
+	// Must only be called once nothing of the TaskManager is left in the queue.
+	// Waits for the workers that are still finishing one of its tasks.
+	void unregisterTaskManager(unsigned int taskManagerIndex);
+
+	// Waits for the workers that are still finishing one of the tasks of a TaskManager that has nothing left in the queue.
+	void waitForWorkers(unsigned int taskManagerIndex) const;
+
+	// Lends a worker index to a thread that wants to run tasks, or returns EXTERNAL_WORKER_INDEX if there's none left.
+	unsigned int acquireHelperIndex();
+	void releaseHelperIndex(unsigned int workerIndex);
+
+private:
+	// The TaskManager a worker is running a task of, padded so that workers don't share cache lines.
+	struct alignas(64) WorkerState
+	{
+		std::atomic<unsigned int> taskManagerIndex{ MAX_TASK_MANAGERS };
+	};
+
+	const TaskExecutorSettings settings;
+	const unsigned int numberOfPoolThreads;
+	std::unique_ptr<TaskQueue> taskQueue;
+
+	// Read by the workers without locking, only registering and unregistering lock.
+	std::unique_ptr<std::atomic<TaskManager*>[]> taskManagers;
+	std::unique_ptr<WorkerState[]> workerStates;
+	std::vector<unsigned int> freeHelperIndices;
+	std::mutex lock;
+
+	std::atomic<bool> beingDestroyed{ false };
+	std::vector<std::thread> threadPool;
+};
@@ -1,87 +1,1130 @@
 #include "TaskManager.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
 
-TaskManager::TaskManager()
+namespace
 {
-	for (unsigned int i = 0; i < NUMBER_OF_THREADS; i++) {
-		threadPool.emplace_back([&]()
-		{
-			while(!beingDestroyed)
-			{
-				const unsigned int nextTaskIndex = taskQueue.pop();
-				tasks[nextTaskIndex].task();
-				const auto unlockedTasks = taskDependencyGraph.finishTask(nextTaskIndex);
-				for (auto index : unlockedTasks) taskQueue.push(index);
-			}
-		});
+	std::shared_ptr<TaskExecutor> makeExecutor(const TaskManagerSettings& settings)
+	{
+		TaskExecutorSettings executorSettings;
+		executorSettings.schedulingMode = settings.schedulingMode;
+		executorSettings.numberOfThreads = settings.numberOfThreads;
+		executorSettings.spinIterations = settings.spinIterations;
+		return std::make_shared<TaskExecutor>(executorSettings);
 	}
 
-	// This task is used to terminate all the threads.
+	// What the current thread is running, so that spawned children know where they belong.
+	struct RunningTask
+	{
+		const TaskManager* taskManager;
+		unsigned int workerIndex;
+		unsigned int queueEntry;
+		unsigned int slot;
+		float priority;
+		std::atomic<unsigned int>* joinCounter;
+		bool spawnedChildren;
+	};
+
+	thread_local RunningTask* runningTask = nullptr;
+}
+
+TaskManager::TaskManager(const TaskManagerSettings& settings, std::shared_ptr<TaskExecutor> executor) :
+	settings(settings),
+	executor(executor ? executor : makeExecutor(settings)),
+	numberOfWorkers(this->executor->getNumberOfWorkers()),
+	taskQueue(&this->executor->getTaskQueue()),
+	taskTracer(numberOfWorkers),
+	childTaskBlocks(new std::unique_ptr<ChildTask[]>[MAX_CHILD_TASK_BLOCKS]),
+	slotTicks(settings.pipelineDepth, 0),
+	slotPromises(settings.pipelineDepth),
+	slotStartTimes(settings.pipelineDepth),
+	workerTickCounters(settings.pipelineDepth * numberOfWorkers),
+	slotsFinished(new std::atomic<bool>[settings.pipelineDepth]),
+	slotCallerHelps(settings.pipelineDepth, false),
+	slotsStaticallyScheduled(new std::atomic<bool>[settings.pipelineDepth])
+{
+	if (settings.pipelineDepth == 0 || settings.pipelineDepth > MAX_PIPELINE_DEPTH)
+		throw std::invalid_argument("The pipeline depth must be between 1 and " + std::to_string(MAX_PIPELINE_DEPTH) + ".");
+
+	for (unsigned int i = 0; i < settings.pipelineDepth; i++) slotsStaticallyScheduled[i].store(false, std::memory_order_relaxed);
+	for (unsigned int i = 0; i < settings.pipelineDepth * numberOfWorkers; i++) frameArenas.emplace_back(new FrameArena(settings.frameArenaSize));
+
+	taskManagerIndex = this->executor->registerTaskManager(this);
+	queueEntryOwner = static_cast<std::uint64_t>(taskManagerIndex) << 32;
+
+	// This task is never scheduled, it keeps the index 0 out of the way.
 	TaskInformation dummyTask;
 	dummyTask.name = DUMMY_TASK_IDENTIFIER;
 	dummyTask.task = []() {};
-	tasks.push_back(dummyTask);
+	addTask(dummyTask);
 
 	// This task is used to signal a new tick.
 	TaskInformation firstTask;
 	firstTask.name = FIRST_TASK_IDENTIFIER;
 	firstTask.task = []() {};
-	tasks.push_back(firstTask);
+	addTask(firstTask);
 
-	// This task is used to return control to the world.
+	// This task is used to return control to the world, once it's done the tick is over.
 	TaskInformation lastTask;
 	lastTask.name = LAST_TASK_IDENTIFIER;
-	lastTask.task = [&]()
-	{
-		std::unique_lock<std::mutex> ul(lock);
-		isDone = true;
-		cv.notify_one();
-		taskDependencyGraph.reset();
-	};
-	tasks.push_back(lastTask);
+	lastTask.task = []() {};
+	addTask(lastTask);
 }
 
 TaskManager::~TaskManager()
 {
-	beingDestroyed = true;
-	for (auto& thr : threadPool) taskQueue.push(DUMMY_TASK_INDEX);
-	for (auto& thr : threadPool) thr.join();
+	{
+		std::unique_lock<std::mutex> ul(lock);
+		cv.wait(ul, [&]() { return numberOfTicksRetired == numberOfTicksStarted; });
+	}
+
+	executor->unregisterTaskManager(taskManagerIndex);
 }
 
 void TaskManager::addTask(const TaskInformation& taskInformation)
 {
+	if (taskInformation.getRangeEnd && !taskInformation.rangeTask) throw std::invalid_argument("The task \"" + taskInformation.name + "\" reads the end of its range but has no range task.");
+	if (taskInformation.rangeTask)
+	{
+		if (taskInformation.task) throw std::invalid_argument("The task \"" + taskInformation.name + "\" can't have both a task and a range task.");
+		if (!taskInformation.getRangeEnd && taskInformation.rangeEnd < taskInformation.rangeBegin) throw std::invalid_argument("The range of the task \"" + taskInformation.name + "\" ends before it begins.");
+		if (taskInformation.grainSize == 0) throw std::invalid_argument("The range task \"" + taskInformation.name + "\" has a grain size of 0.");
+	}
+	if (!(taskInformation.cost >= 0.0f)) throw std::invalid_argument("The task \"" + taskInformation.name + "\" has a negative cost.");
+	if (taskInformation.period == 0) throw std::invalid_argument("The task \"" + taskInformation.name + "\" has a period of 0.");
+	if (taskInformation.phase != AUTOMATIC_PHASE && taskInformation.phase >= taskInformation.period)
+		throw std::invalid_argument("The phase of the task \"" + taskInformation.name + "\" isn't smaller than its period.");
+
+	{
+		std::lock_guard<std::mutex> lg(lock);
+		if (graphGenerated)
+		{
+			taskChanges.push_back({ taskInformation, false });
+			return;
+		}
+	}
+
+	insertTask(taskInformation);
+}
+
+void TaskManager::removeTask(const std::string& name)
+{
+	if (name == DUMMY_TASK_IDENTIFIER || name == FIRST_TASK_IDENTIFIER || name == LAST_TASK_IDENTIFIER)
+		throw std::invalid_argument("The internal task \"" + name + "\" can't be removed.");
+
+	{
+		std::lock_guard<std::mutex> lg(lock);
+		if (graphGenerated)
+		{
+			TaskInformation taskInformation;
+			taskInformation.name = name;
+			taskChanges.push_back({ taskInformation, true });
+			return;
+		}
+	}
+
+	eraseTask(name);
+}
+
+void TaskManager::insertTask(const TaskInformation& taskInformation)
+{
+	if (!taskIndices.emplace(taskInformation.name, static_cast<unsigned int>(tasks.size())).second)
+		throw std::invalid_argument("A task named \"" + taskInformation.name + "\" was already added.");
+
 	tasks.push_back(taskInformation);
 }
 
+void TaskManager::eraseTask(const std::string& name)
+{
+	const auto task = taskIndices.find(name);
+	if (task == taskIndices.end()) throw std::invalid_argument("There's no task named \"" + name + "\" to remove.");
+
+	// The tasks after it move down by one.
+	const unsigned int taskIndex = task->second;
+	taskIndices.erase(task);
+	tasks.erase(tasks.begin() + taskIndex);
+	for (unsigned int i = taskIndex; i < tasks.size(); i++) taskIndices[tasks[i].name] = i;
+}
+
+void TaskManager::applyTaskChanges()
+{
+	std::unique_lock<std::mutex> ul(lock);
+	if (taskChanges.empty()) return;
+
+	// The ticks in flight share the graph, so they have to be over, along with the workers still finishing their tasks.
+	cv.wait(ul, [&]() { return numberOfTicksRetired == numberOfTicksStarted; });
+	executor->waitForWorkers(taskManagerIndex);
+
+	std::vector<TaskChange> changes;
+	changes.swap(taskChanges);
+	const std::vector<TaskInformation> previousTasks = tasks;
+	const std::unordered_map<std::string, unsigned int> previousTaskIndices = taskIndices;
+	try
+	{
+		for (const auto& change : changes)
+		{
+			if (change.removed) eraseTask(change.task.name);
+			else insertTask(change.task);
+		}
+		generateDependencyGraph();
+	}
+	catch (const std::invalid_argument&)
+	{
+		// The previous graph was already generated from these tasks, so this can't fail.
+		tasks = previousTasks;
+		taskIndices = previousTaskIndices;
+		generateDependencyGraph();
+		throw;
+	}
+}
+
 void TaskManager::generateDependencyGraph()
 {
-	// Adding the dependency of the first task to every other task.
-	for (unsigned int i = FIRST_TASK_INDEX + 1; i < tasks.size(); i++) tasks[i].precedingTasks.emplace_back(FIRST_TASK_IDENTIFIER);
+	std::vector<Dependency> dependencies;
+	std::vector<Dependency> crossTickDependencies;
+	const std::string errors = collectDependencies(dependencies, crossTickDependencies);
+	if (!errors.empty()) throw std::invalid_argument("Couldn't generate the dependency graph:" + errors);
+
+	// Running order among the user-created tasks, in compressed sparse row form.
+	removeRedundantDependencies(static_cast<unsigned int>(tasks.size()), dependencies);
+	std::vector<unsigned int> taskPrecedingTaskOffsets(tasks.size() + 1, 0);
+	std::vector<unsigned int> taskPrecedingTasks(dependencies.size());
+	std::vector<bool> hasDependantTasks(tasks.size(), false);
+	std::sort(dependencies.begin(), dependencies.end(), [](const Dependency& a, const Dependency& b)
+	{
+		return a.task != b.task ? a.task < b.task : a.precedingTask < b.precedingTask;
+	});
+	for (unsigned int i = 0; i < dependencies.size(); i++)
+	{
+		taskPrecedingTaskOffsets[dependencies[i].task + 1]++;
+		taskPrecedingTasks[i] = dependencies[i].precedingTask;
+		hasDependantTasks[dependencies[i].precedingTask] = true;
+	}
+	for (unsigned int i = 0; i < tasks.size(); i++) taskPrecedingTaskOffsets[i + 1] += taskPrecedingTaskOffsets[i];
+
+	// Splitting the range tasks into chunks.
+	// The cost of every node is kept aside to rank them once the graph is complete.
+	std::vector<unsigned int> rangeStartNodes(tasks.size(), 0);
+	std::vector<unsigned int> numberOfChunks(tasks.size(), 0);
+	std::vector<float> costs;
+
+	// Checked before adding the chunks, so that a huge range doesn't allocate them first.
+	const auto checkNumberOfNodes = [](std::size_t numberOfNodes)
+	{
+		if (numberOfNodes > MAX_NUMBER_OF_NODES)
+			throw std::invalid_argument("Couldn't generate the dependency graph: the tasks and the chunks of the range tasks add up to "
+				+ std::to_string(numberOfNodes) + " nodes, and there can be at most " + std::to_string(MAX_NUMBER_OF_NODES) + ".");
+	};
+	checkNumberOfNodes(tasks.size());
+
+	runtimeTasks.clear();
+	nodeTaskIndices.clear();
+	for (unsigned int i = 0; i < tasks.size(); i++)
+	{
+		runtimeTasks.push_back({ tasks[i].task });
+		nodeTaskIndices.push_back(i);
+		costs.push_back(i > LAST_TASK_INDEX ? tasks[i].cost : 0.0f);
+	}
+
+	for (unsigned int i = 0; i < tasks.size(); i++)
+	{
+		const TaskInformation& task = tasks[i];
+		if (!task.rangeTask) continue;
+
+		const bool dynamicRange = static_cast<bool>(task.getRangeEnd);
+		if (dynamicRange) numberOfChunks[i] = numberOfWorkers * DYNAMIC_RANGE_CHUNKS_PER_WORKER;
+		else numberOfChunks[i] = (task.rangeEnd - task.rangeBegin) / task.grainSize + ((task.rangeEnd - task.rangeBegin) % task.grainSize != 0);
+		if (!dynamicRange && numberOfChunks[i] <= 1)
+		{
+			// Not worth splitting, the task's own node runs the whole range.
+			if (numberOfChunks[i] == 1) runtimeTasks[i].task = [&task]() { task.rangeTask(task.rangeBegin, task.rangeEnd); };
+			else runtimeTasks[i].task = []() {};
+			continue;
+		}
+
+		// The task's own node just waits for the chunks, so the tasks that depend on it wait for all of them.
+		checkNumberOfNodes(runtimeTasks.size() + 1 + static_cast<std::size_t>(numberOfChunks[i]));
+		runtimeTasks[i].task = []() {};
+		costs[i] = 0.0f;
+		rangeStartNodes[i] = static_cast<unsigned int>(runtimeTasks.size());
+		runtimeTasks.push_back({ []() {} });
+		nodeTaskIndices.push_back(i);
+		costs.push_back(0.0f);
+
+		if (dynamicRange)
+		{
+			// The node that starts the range reads where it ends in this tick, and the chunks split it evenly between them.
+			runtimeTasks.back().task = [this, i]() { rangeEnds[runningTask->slot * tasks.size() + i] = tasks[i].getRangeEnd(); };
+			const unsigned int chunks = numberOfChunks[i];
+			for (unsigned int chunk = 0; chunk < chunks; chunk++)
+			{
+				runtimeTasks.push_back({ [this, i, chunk, chunks]() { runDynamicRangeChunk(i, chunk, chunks); } });
+				nodeTaskIndices.push_back(i);
+				costs.push_back(task.cost / chunks);
+			}
+			continue;
+		}
+
+		// The chunks call the range task where it's stored, which doesn't move once the graph is generated.
+		for (unsigned int begin = task.rangeBegin; begin < task.rangeEnd; )
+		{
+			const unsigned int end = task.rangeEnd - begin > task.grainSize ? begin + task.grainSize : task.rangeEnd;
+			runtimeTasks.push_back({ [&task, begin, end]() { task.rangeTask(begin, end); } });
+			nodeTaskIndices.push_back(i);
+			costs.push_back(task.cost * (end - begin) / (task.rangeEnd - task.rangeBegin));
+			begin = end;
+		}
+	}
+
+	rangeEnds.assign(settings.pipelineDepth * tasks.size(), 0);
+
+	std::vector<unsigned int> precedingTaskOffsets;
+	std::vector<unsigned int> precedingTasks;
+
+	precedingTaskOffsets.reserve(runtimeTasks.size() + 1);
+	for (unsigned int node = 0; node < runtimeTasks.size(); node++)
+	{
+		const unsigned int i = nodeTaskIndices[node];
+		precedingTaskOffsets.push_back(static_cast<unsigned int>(precedingTasks.size()));
+
+		if (node == i && rangeStartNodes[i] != 0)
+		{
+			// A split range task waits for its chunks.
+			for (unsigned int j = 1; j <= numberOfChunks[i]; j++) precedingTasks.push_back(rangeStartNodes[i] + j);
+		}
+		else if (node != i && node != rangeStartNodes[i])
+		{
+			// A chunk waits for the node that starts its range task.
+			precedingTasks.push_back(rangeStartNodes[i]);
+		}
+		else if (i == LAST_TASK_INDEX)
+		{
+			// The last task only has to wait for the tasks nothing else waits for.
+			for (unsigned int j = LAST_TASK_INDEX + 1; j < tasks.size(); j++) if (!hasDependantTasks[j]) precedingTasks.push_back(j);
+			if (precedingTasks.size() == precedingTaskOffsets.back()) precedingTasks.push_back(FIRST_TASK_INDEX);
+		}
+		else if (i > LAST_TASK_INDEX)
+		{
+			// The tasks that don't wait for any other wait for the first task.
+			precedingTasks.insert(precedingTasks.end(), taskPrecedingTasks.begin() + taskPrecedingTaskOffsets[i], taskPrecedingTasks.begin() + taskPrecedingTaskOffsets[i + 1]);
+			if (precedingTasks.size() == precedingTaskOffsets.back()) precedingTasks.push_back(FIRST_TASK_INDEX);
+		}
+	}
+	precedingTaskOffsets.push_back(static_cast<unsigned int>(precedingTasks.size()));
+
+	// When ticks overlap, a task of the next tick has to wait for the ones of the previous tick it conflicts with.
+	// A range task gets started again by the node that starts its chunks.
+	for (auto& dependency : crossTickDependencies)
+	{
+		if (rangeStartNodes[dependency.task] != 0) dependency.task = rangeStartNodes[dependency.task];
+	}
+	std::sort(crossTickDependencies.begin(), crossTickDependencies.end(), [](const Dependency& a, const Dependency& b)
+	{
+		return a.precedingTask != b.precedingTask ? a.precedingTask < b.precedingTask : a.task < b.task;
+	});
+
+	std::vector<unsigned int> nextTickTaskOffsets(runtimeTasks.size() + 1, 0);
+	std::vector<unsigned int> nextTickTasks;
+	for (unsigned int i = 0; i < crossTickDependencies.size(); i++)
+	{
+		// Every task already waits for itself, and the internal tasks only order tasks within a tick.
+		const Dependency& dependency = crossTickDependencies[i];
+		if (dependency.task == dependency.precedingTask || dependency.task <= LAST_TASK_INDEX || dependency.precedingTask <= LAST_TASK_INDEX) continue;
+		if (i > 0 && dependency.task == crossTickDependencies[i - 1].task && dependency.precedingTask == crossTickDependencies[i - 1].precedingTask) continue;
+
+		nextTickTaskOffsets[dependency.precedingTask + 1]++;
+		nextTickTasks.push_back(dependency.task);
+	}
+	for (unsigned int node = 0; node < runtimeTasks.size(); node++) nextTickTaskOffsets[node + 1] += nextTickTaskOffsets[node];
+
+	taskDependencyGraph.init(precedingTaskOffsets, precedingTasks, settings.pipelineDepth, nextTickTaskOffsets, nextTickTasks);
+
+	// After a change to the tasks, the next tick is the first one of the new graph, and it might not be in the first slot.
+	taskDependencyGraph.restart(static_cast<unsigned int>(numberOfTicksStarted % settings.pipelineDepth));
+	taskTracer.setNumberOfTasks(static_cast<unsigned int>(runtimeTasks.size()), settings.pipelineDepth);
+
+	const auto cycle = taskDependencyGraph.findCycle();
+	if (!cycle.empty())
+	{
+		// The nodes of a range task all show up with the range task's name, so they are only listed once.
+		std::vector<unsigned int> cycleTasks;
+		for (unsigned int node : cycle)
+		{
+			const unsigned int task = nodeTaskIndices[node];
+			if (cycleTasks.empty() || cycleTasks.back() != task) cycleTasks.push_back(task);
+		}
+		if (cycleTasks.size() > 1 && cycleTasks.back() == cycleTasks.front()) cycleTasks.pop_back();
+
+		std::string cycleDescription;
+		for (unsigned int task : cycleTasks) cycleDescription += "\"" + tasks[task].name + "\" -> ";
+		throw std::invalid_argument("Couldn't generate the dependency graph, there's a dependency cycle: " + cycleDescription + "\"" + tasks[cycleTasks.front()].name + "\".");
+	}
+
+	nodePriorities = taskDependencyGraph.computeRanks(costs);
+
+	const std::vector<unsigned int> phases = choosePhases();
+	nodePeriods.clear();
+	nodePhases.clear();
+	for (unsigned int i : nodeTaskIndices)
+	{
+		nodePeriods.push_back(tasks[i].period);
+		nodePhases.push_back(phases[i]);
+	}
+	nodeCosts = costs;
+
+	// A link of a chain is fused when the node is the only one waiting for the previous node, and waits for nothing else
+	// within the tick. Periodic and range tasks are left alone, so that only plain tasks run back to back.
+	nodeChainSuccessors.assign(runtimeTasks.size(), DUMMY_TASK_INDEX);
+	if (settings.fuseChains)
+	{
+		const auto isFusable = [&](unsigned int node)
+		{
+			return node > LAST_TASK_INDEX && node < tasks.size() && !tasks[node].isolated && !tasks[node].rangeTask && tasks[node].period == 1;
+		};
+
+		std::vector<unsigned int> numberOfDependants(runtimeTasks.size(), 0);
+		for (unsigned int precedingTask : precedingTasks) numberOfDependants[precedingTask]++;
+		for (unsigned int node = 0; node < runtimeTasks.size(); node++)
+		{
+			if (precedingTaskOffsets[node + 1] - precedingTaskOffsets[node] != 1) continue;
+
+			const unsigned int precedingTask = precedingTasks[precedingTaskOffsets[node]];
+			if (numberOfDependants[precedingTask] == 1 && isFusable(node) && isFusable(precedingTask)) nodeChainSuccessors[precedingTask] = node;
+		}
+	}
+	nodeJoinCounters.reset(new std::atomic<unsigned int>[settings.pipelineDepth * runtimeTasks.size()]);
+	for (unsigned int i = 0; i < settings.pipelineDepth * runtimeTasks.size(); i++) nodeJoinCounters[i].store(0, std::memory_order_relaxed);
+
+	// The measurements and the schedule made from them belong to the previous graph.
+	nodeDurations.assign(runtimeTasks.size(), 0.0f);
+	staticSchedule.clear();
+	nodeFinishedTicks.reset(new std::atomic<std::uint64_t>[runtimeTasks.size()]);
+	nodeWaitingLists.reset(new std::atomic<unsigned int>[runtimeTasks.size()]);
+	for (unsigned int i = 0; i < runtimeTasks.size(); i++)
+	{
+		nodeFinishedTicks[i].store(0, std::memory_order_relaxed);
+		nodeWaitingLists[i].store(0, std::memory_order_relaxed);
+	}
+
+	graphGenerated = true;
+}
+
+std::string TaskManager::collectDependencies(std::vector<Dependency>& dependencies, std::vector<Dependency>& crossTickDependencies) const
+{
+	std::string errors;
 
-	// Adding the dependency of every user-created task to the last task.
-	for (unsigned int i = LAST_TASK_INDEX + 1; i < tasks.size(); i++) tasks[LAST_TASK_INDEX].precedingTasks.push_back(tasks[i].name);
+	// The dependencies written by hand. The preceding task of the next tick has to wait for its dependant,
+	// so that it doesn't overwrite what the dependant hasn't read yet.
+	for (unsigned int i = 0; i < tasks.size(); i++)
+	{
+		for (const auto& precedingTaskName : tasks[i].precedingTasks)
+		{
+			const auto precedingTask = taskIndices.find(precedingTaskName);
+			if (precedingTask == taskIndices.end())
+			{
+				errors += "\n\"" + tasks[i].name + "\" depends on \"" + precedingTaskName + "\", which was never added.";
+				continue;
+			}
+
+			dependencies.push_back({ precedingTask->second, i });
+			crossTickDependencies.push_back({ i, precedingTask->second });
+		}
+	}
+
+	// The dependencies coming from the resources, going through the tasks in the order they were added.
+	struct ResourceAccesses
+	{
+		int lastWriter = -1;
+		std::vector<unsigned int> readersSinceLastWrite;
+
+		// What the next tick does first with the resource.
+		int firstWriter = -1;
+		std::vector<unsigned int> readersBeforeFirstWrite;
+	};
+	std::unordered_map<std::string, unsigned int> resourceIndices;
+	std::vector<ResourceAccesses> resources;
+	const auto resourceAccesses = [&](const std::string& resourceName) -> ResourceAccesses&
+	{
+		const auto resource = resourceIndices.emplace(resourceName, static_cast<unsigned int>(resources.size()));
+		if (resource.second) resources.emplace_back();
+		return resources[resource.first->second];
+	};
+
+	for (unsigned int i = 0; i < tasks.size(); i++)
+	{
+		for (const auto& resourceName : tasks[i].readResources)
+		{
+			// Writing already orders the task with everything reading the resource.
+			if (std::find(tasks[i].writtenResources.begin(), tasks[i].writtenResources.end(), resourceName) != tasks[i].writtenResources.end()) continue;
+
+			ResourceAccesses& resource = resourceAccesses(resourceName);
+			if (resource.lastWriter >= 0) dependencies.push_back({ static_cast<unsigned int>(resource.lastWriter), i });
+			else resource.readersBeforeFirstWrite.push_back(i);
+			resource.readersSinceLastWrite.push_back(i);
+		}
+
+		for (const auto& resourceName : tasks[i].writtenResources)
+		{
+			ResourceAccesses& resource = resourceAccesses(resourceName);
+			if (resource.lastWriter >= 0) dependencies.push_back({ static_cast<unsigned int>(resource.lastWriter), i });
+			for (unsigned int reader : resource.readersSinceLastWrite) dependencies.push_back({ reader, i });
+			resource.readersSinceLastWrite.clear();
+
+			if (resource.firstWriter < 0) resource.firstWriter = i;
+			resource.lastWriter = i;
+		}
+	}
+
+	// The next tick's first accesses to every resource have to wait for the last ones of the previous tick.
+	for (const auto& resource : resources)
+	{
+		if (resource.lastWriter < 0) continue;
+
+		for (unsigned int reader : resource.readersBeforeFirstWrite) crossTickDependencies.push_back({ static_cast<unsigned int>(resource.lastWriter), reader });
+		crossTickDependencies.push_back({ static_cast<unsigned int>(resource.lastWriter), static_cast<unsigned int>(resource.firstWriter) });
+		for (unsigned int reader : resource.readersSinceLastWrite) crossTickDependencies.push_back({ reader, static_cast<unsigned int>(resource.firstWriter) });
+	}
+
+	return errors;
+}
+
+void TaskManager::removeRedundantDependencies(unsigned int numberOfTasks, std::vector<Dependency>& dependencies)
+{
+	// Grouping the dependants of every task.
+	std::sort(dependencies.begin(), dependencies.end(), [](const Dependency& a, const Dependency& b)
+	{
+		return a.precedingTask != b.precedingTask ? a.precedingTask < b.precedingTask : a.task < b.task;
+	});
+	dependencies.erase(std::unique(dependencies.begin(), dependencies.end(), [](const Dependency& a, const Dependency& b)
+	{
+		return a.precedingTask == b.precedingTask && a.task == b.task;
+	}), dependencies.end());
+
+	std::vector<unsigned int> dependantTaskOffsets(numberOfTasks + 1, 0);
+	for (const auto& dependency : dependencies) dependantTaskOffsets[dependency.precedingTask + 1]++;
+	for (unsigned int i = 0; i < numberOfTasks; i++) dependantTaskOffsets[i + 1] += dependantTaskOffsets[i];
+
+	// Sorting the tasks so that every task comes before its dependants. If there's a cycle nothing else is removed,
+	// so that findCycle() reports it.
+	std::vector<unsigned int> remainingPrecedingTasks(numberOfTasks, 0);
+	for (const auto& dependency : dependencies) remainingPrecedingTasks[dependency.task]++;
+	std::vector<unsigned int> order;
+	order.reserve(numberOfTasks);
+	for (unsigned int task = 0; task < numberOfTasks; task++) if (remainingPrecedingTasks[task] == 0) order.push_back(task);
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		for (unsigned int j = dependantTaskOffsets[order[i]]; j < dependantTaskOffsets[order[i] + 1]; j++)
+		{
+			if (--remainingPrecedingTasks[dependencies[j].task] == 0) order.push_back(dependencies[j].task);
+		}
+	}
+	if (order.size() < numberOfTasks) return;
+
+	std::vector<unsigned int> positions(numberOfTasks);
+	for (unsigned int i = 0; i < numberOfTasks; i++) positions[order[i]] = i;
+
+	// A dependency is redundant if the dependant can be reached through another dependant of the same task.
+	// What every task reaches is kept as a bitset over a block of the sorted tasks at a time, built from its dependants
+	// going backwards through the order. Only the tasks before the end of the block can reach it.
+	const unsigned int words = TRANSITIVE_REDUCTION_BLOCK_SIZE / 64;
+	std::vector<std::uint64_t> reached(static_cast<std::size_t>(numberOfTasks) * words);
+	std::vector<std::uint64_t> reachedThroughDependants(words);
+	std::vector<bool> redundant(dependencies.size(), false);
+	for (unsigned int blockStart = 0; blockStart < numberOfTasks; blockStart += TRANSITIVE_REDUCTION_BLOCK_SIZE)
+	{
+		const unsigned int blockEnd = std::min(blockStart + TRANSITIVE_REDUCTION_BLOCK_SIZE, numberOfTasks);
+		std::fill(reached.begin(), reached.begin() + static_cast<std::size_t>(blockEnd) * words, 0);
+
+		for (unsigned int position = blockEnd; position-- > 0;)
+		{
+			const unsigned int task = order[position];
+			std::uint64_t* taskReached = &reached[static_cast<std::size_t>(position) * words];
+
+			// What the dependants reach, without the dependants themselves.
+			std::fill(reachedThroughDependants.begin(), reachedThroughDependants.end(), 0);
+			for (unsigned int j = dependantTaskOffsets[task]; j < dependantTaskOffsets[task + 1]; j++)
+			{
+				const unsigned int dependantPosition = positions[dependencies[j].task];
+				if (dependantPosition >= blockEnd) continue;
+
+				const std::uint64_t* dependantReached = &reached[static_cast<std::size_t>(dependantPosition) * words];
+				for (unsigned int word = 0; word < words; word++) reachedThroughDependants[word] |= dependantReached[word];
+			}
+
+			for (unsigned int word = 0; word < words; word++) taskReached[word] = reachedThroughDependants[word];
+			for (unsigned int j = dependantTaskOffsets[task]; j < dependantTaskOffsets[task + 1]; j++)
+			{
+				const unsigned int dependantPosition = positions[dependencies[j].task];
+				if (dependantPosition < blockStart || dependantPosition >= blockEnd) continue;
+
+				const unsigned int bit = dependantPosition - blockStart;
+				redundant[j] = (reachedThroughDependants[bit / 64] >> (bit % 64)) & 1;
+				taskReached[bit / 64] |= std::uint64_t(1) << (bit % 64);
+			}
+		}
+	}
+
+	unsigned int kept = 0;
+	for (unsigned int j = 0; j < dependencies.size(); j++) if (!redundant[j]) dependencies[kept++] = dependencies[j];
+	dependencies.resize(kept);
+}
+
+std::vector<unsigned int> TaskManager::choosePhases() const
+{
+	std::vector<unsigned int> phases(tasks.size(), 0);
+
+	// The automatic phases repeat every least common multiple of their periods, as long as it's not too long.
+	unsigned int cycle = 1;
+	unsigned int longestPeriod = 1;
+	std::vector<unsigned int> automaticTasks;
+	for (unsigned int i = 0; i < tasks.size(); i++)
+	{
+		if (tasks[i].period == 1 || tasks[i].phase != AUTOMATIC_PHASE) continue;
 
-	std::vector<std::vector<unsigned int>> dependencies(tasks.size(), std::vector<unsigned int>());
+		automaticTasks.push_back(i);
+		cycle = static_cast<unsigned int>(std::min<std::uint64_t>(std::lcm<std::uint64_t>(cycle, tasks[i].period), MAX_PHASE_CYCLE));
+		longestPeriod = std::max(longestPeriod, tasks[i].period);
+	}
+	cycle = std::max(cycle, longestPeriod);
 
+	// The load that every tick of the cycle already has from the periodic tasks with a fixed phase.
+	std::vector<float> load(cycle, 0.0f);
 	for (unsigned int i = 0; i < tasks.size(); i++)
 	{
-		for (unsigned int j = 0; j < tasks.size(); j++)
+		if (tasks[i].period == 1 || tasks[i].phase == AUTOMATIC_PHASE) continue;
+
+		phases[i] = tasks[i].phase;
+		for (unsigned int tick = tasks[i].phase; tick < cycle; tick += tasks[i].period) load[tick] += tasks[i].cost;
+	}
+
+	// Placing the most expensive tasks first, each one on the phase whose heaviest tick is the lightest.
+	std::stable_sort(automaticTasks.begin(), automaticTasks.end(), [&](unsigned int a, unsigned int b) { return tasks[a].cost > tasks[b].cost; });
+	for (unsigned int i : automaticTasks)
+	{
+		const unsigned int period = tasks[i].period;
+		float lightestLoad = 0.0f;
+		for (unsigned int phase = 0; phase < period; phase++)
 		{
-			if(std::find(tasks[i].precedingTasks.begin(), tasks[i].precedingTasks.end(), tasks[j].name) != tasks[i].precedingTasks.end())
+			float heaviestLoad = 0.0f;
+			for (unsigned int tick = phase; tick < cycle; tick += period) heaviestLoad = std::max(heaviestLoad, load[tick]);
+			if (phase == 0 || heaviestLoad < lightestLoad)
 			{
-				dependencies[i].push_back(j);
+				lightestLoad = heaviestLoad;
+				phases[i] = phase;
 			}
 		}
+
+		for (unsigned int tick = phases[i]; tick < cycle; tick += period) load[tick] += tasks[i].cost;
+	}
+
+	return phases;
+}
+
+void TaskManager::runTask(unsigned int workerIndex, unsigned int queueEntry)
+{
+	if (queueEntry & CHILD_TASK_FLAG)
+	{
+		runChildTask(workerIndex, queueEntry & ~CHILD_TASK_FLAG);
+		return;
+	}
+	if (queueEntry & STATIC_SCHEDULE_FLAG)
+	{
+		runStaticSchedule(workerIndex, queueEntry);
+		return;
+	}
+
+	do queueEntry = runNode(workerIndex, queueEntry);
+	while (queueEntry != 0);
+}
+
+unsigned int TaskManager::runNode(unsigned int workerIndex, unsigned int queueEntry)
+{
+	const unsigned int taskIndex = queueEntry >> TICK_SLOT_BITS;
+	const unsigned int slot = queueEntry & (MAX_PIPELINE_DEPTH - 1);
+	if (!executeNode(workerIndex, taskIndex, slot)) return 0;
+
+	return finishNode(workerIndex, taskIndex, slot);
+}
+
+bool TaskManager::executeNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot)
+{
+	const std::uint64_t startTime = taskTracer.isEnabled() ? taskTracer.now() : 0;
+	const bool measureDuration = settings.measureTaskDurations;
+	const auto measureStartTime = measureDuration ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+	WorkerTickCounters& counters = workerTickCounters[slot * numberOfWorkers + workerIndex];
+	if (taskIndex > LAST_TASK_INDEX && taskIndex < tasks.size()) counters.numberOfTasksRun++;
+	counters.costOfTasksRun += nodeCosts[taskIndex];
+
+	std::atomic<unsigned int>& joinCounter = nodeJoinCounters[slot * runtimeTasks.size() + taskIndex];
+	RunningTask currentTask{ this, workerIndex, toQueueEntry(taskIndex, slot), slot, nodePriorities[taskIndex], &joinCounter, false };
+	RunningTask* previousTask = runningTask;
+	runningTask = &currentTask;
+	runtimeTasks[taskIndex].task();
+	runningTask = previousTask;
+
+	if (taskTracer.isEnabled()) taskTracer.recordTask(workerIndex, taskIndex, slot, slotTicks[slot], startTime, taskTracer.now());
+
+	// Only the node itself is measured, its children run on their own.
+	if (measureDuration)
+	{
+		const float duration = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - measureStartTime).count();
+		float& averageDuration = nodeDurations[taskIndex];
+		if (averageDuration == 0.0f) averageDuration = duration;
+		else averageDuration += TASK_DURATION_SMOOTHING * (std::min(duration, MAX_TASK_DURATION_GROWTH * averageDuration) - averageDuration);
+
+		if (slotsStaticallyScheduled[slot].load(std::memory_order_relaxed)) counters.durationDrift += std::abs(averageDuration - staticScheduleDurations[taskIndex]);
+	}
+
+	// The last child to finish takes care of the rest.
+	return !currentTask.spawnedChildren || joinCounter.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+unsigned int TaskManager::finishNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot)
+{
+	if (slotsStaticallyScheduled[slot].load(std::memory_order_relaxed))
+	{
+		finishScheduledNode(workerIndex, taskIndex, slot);
+		return 0;
+	}
+
+	// This has to happen before the last task of the next tick gets released, so that ticks finish in order.
+	if (taskIndex == LAST_TASK_INDEX) finishTick(slot);
+
+	// The fused node can also be unlocked later by the previous tick, then it goes through the queue like any other.
+	// Among the rest, the node with the highest priority is kept as the continuation, and the one it replaces gets queued.
+	unsigned int nextQueueEntry = 0;
+	bool nextIsFused = false;
+	ReleasedNodes releasedNodes;
+	taskDependencyGraph.finishTask(taskIndex, slot, [&](unsigned int index, unsigned int unlockedSlot)
+	{
+		const bool isFused = index == nodeChainSuccessors[taskIndex] && unlockedSlot == slot;
+		const bool canBeKept = isFused || (settings.inlineContinuations && !nextIsFused && !isSkipped(index, unlockedSlot)
+			&& (nextQueueEntry == 0 || nodePriorities[index] > nodePriorities[nextQueueEntry >> TICK_SLOT_BITS]));
+		if (!canBeKept)
+		{
+			releaseNode(workerIndex, index, unlockedSlot, releasedNodes);
+			return;
+		}
+
+		if (nextQueueEntry != 0) queueNode(workerIndex, nextQueueEntry, releasedNodes);
+		taskTracer.markReady(index, unlockedSlot);
+		nextQueueEntry = toQueueEntry(index, unlockedSlot);
+		nextIsFused = isFused;
+	});
+	finishSkippedNodes(workerIndex, releasedNodes);
+	pushReleasedNodes(workerIndex, releasedNodes);
+
+	// Notifying while locked, since the TaskManager can be destroyed as soon as the lock is free.
+	if (taskIndex == LAST_TASK_INDEX)
+	{
+		std::lock_guard<std::mutex> lg(lock);
+		numberOfTicksRetired++;
+		cv.notify_all();
+	}
+
+	return nextQueueEntry;
+}
+
+void TaskManager::releaseNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot, ReleasedNodes& releasedNodes)
+{
+	if (isSkipped(taskIndex, slot))
+	{
+		// The chunks of a range task are skipped along with it, but only the task counts.
+		if (taskIndex < tasks.size()) workerTickCounters[slot * numberOfWorkers + workerIndex].numberOfTasksSkipped++;
+		releasedNodes.skippedNodes.push_back(toQueueEntry(taskIndex, slot));
+		return;
+	}
+
+	taskTracer.markReady(taskIndex, slot);
+	queueNode(workerIndex, toQueueEntry(taskIndex, slot), releasedNodes);
+}
+
+void TaskManager::finishSkippedNodes(unsigned int workerIndex, ReleasedNodes& releasedNodes)
+{
+	while (!releasedNodes.skippedNodes.empty())
+	{
+		const unsigned int queueEntry = releasedNodes.skippedNodes.back();
+		releasedNodes.skippedNodes.pop_back();
+		const unsigned int taskIndex = queueEntry >> TICK_SLOT_BITS;
+		const unsigned int slot = queueEntry & (MAX_PIPELINE_DEPTH - 1);
+		if (slotsStaticallyScheduled[slot].load(std::memory_order_relaxed))
+		{
+			finishScheduledNode(workerIndex, taskIndex, slot);
+			continue;
+		}
+
+		// Nothing ran, so there's no point in keeping a continuation on this thread.
+		taskDependencyGraph.finishTask(taskIndex, slot, [&](unsigned int index, unsigned int unlockedSlot)
+		{
+			releaseNode(workerIndex, index, unlockedSlot, releasedNodes);
+		});
+	}
+}
+
+void TaskManager::queueNode(unsigned int workerIndex, unsigned int queueEntry, ReleasedNodes& releasedNodes)
+{
+	if (releasedNodes.numberOfNodes == RELEASE_BATCH_SIZE) pushReleasedNodes(workerIndex, releasedNodes);
+
+	releasedNodes.queueEntries[releasedNodes.numberOfNodes] = queueEntryOwner | queueEntry;
+	releasedNodes.priorities[releasedNodes.numberOfNodes] = nodePriorities[queueEntry >> TICK_SLOT_BITS];
+	releasedNodes.numberOfNodes++;
+}
+
+void TaskManager::pushReleasedNodes(unsigned int workerIndex, ReleasedNodes& releasedNodes)
+{
+	if (releasedNodes.numberOfNodes == 0) return;
+
+	taskQueue->push(workerIndex, releasedNodes.queueEntries, releasedNodes.priorities, releasedNodes.numberOfNodes);
+	releasedNodes.numberOfNodes = 0;
+}
+
+void TaskManager::runStaticSchedule(unsigned int workerIndex, unsigned int queueEntry)
+{
+	// The list is only read while some of its nodes are left, since the schedule can be replaced once the tick is over.
+	const unsigned int listIndex = queueEntry & (MAX_STATIC_SCHEDULE_WORKERS - 1);
+	const unsigned int* listNodes = staticSchedule[listIndex].data();
+	const unsigned int listSize = static_cast<unsigned int>(staticSchedule[listIndex].size());
+	const std::uint64_t tick = slotTicks[0];
+
+	for (unsigned int position = (queueEntry & ~STATIC_SCHEDULE_FLAG) >> STATIC_SCHEDULE_WORKER_BITS; position < listSize; position++)
+	{
+		const unsigned int taskIndex = listNodes[position];
+		if (!arePrecedingTasksFinished(taskIndex, tick))
+		{
+			// Leaving the list with the node, and checking again in case the last preceding task finished meanwhile.
+			// Either we take the list back, or the thread that finished it queues the list again.
+			const unsigned int waitingEntry = STATIC_SCHEDULE_FLAG | position << STATIC_SCHEDULE_WORKER_BITS | listIndex;
+			nodeWaitingLists[taskIndex].store(waitingEntry, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!arePrecedingTasksFinished(taskIndex, tick) || nodeWaitingLists[taskIndex].exchange(0, std::memory_order_acq_rel) != waitingEntry) return;
+		}
+
+		if (isSkipped(taskIndex, 0))
+		{
+			if (taskIndex < tasks.size()) workerTickCounters[workerIndex].numberOfTasksSkipped++;
+			finishScheduledNode(workerIndex, taskIndex, 0);
+			continue;
+		}
+
+		taskTracer.markReady(taskIndex, 0);
+		if (executeNode(workerIndex, taskIndex, 0)) finishScheduledNode(workerIndex, taskIndex, 0);
+	}
+}
+
+void TaskManager::finishScheduledNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot)
+{
+	// Once the tick is finished, the next one can take over the slot.
+	const std::uint64_t tick = slotTicks[slot];
+	if (taskIndex == LAST_TASK_INDEX) finishTick(slot);
+
+	nodeFinishedTicks[taskIndex].store(tick + 1, std::memory_order_release);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	taskDependencyGraph.forEachDependantTask(taskIndex, [&](unsigned int dependantTaskIndex)
+	{
+		std::atomic<unsigned int>& waitingList = nodeWaitingLists[dependantTaskIndex];
+		if (waitingList.load(std::memory_order_relaxed) == 0 || !arePrecedingTasksFinished(dependantTaskIndex, tick)) return;
+
+		const unsigned int waitingEntry = waitingList.exchange(0, std::memory_order_acq_rel);
+		if (waitingEntry != 0) taskQueue->push(workerIndex, queueEntryOwner | waitingEntry, nodePriorities[dependantTaskIndex]);
+	});
+
+	// Notifying while locked, since the TaskManager can be destroyed as soon as the lock is free.
+	if (taskIndex == LAST_TASK_INDEX)
+	{
+		std::lock_guard<std::mutex> lg(lock);
+		numberOfTicksRetired++;
+		cv.notify_all();
+	}
+}
+
+bool TaskManager::arePrecedingTasksFinished(unsigned int taskIndex, std::uint64_t tick) const
+{
+	return taskDependencyGraph.allPrecedingTasks(taskIndex, [&](unsigned int precedingTaskIndex)
+	{
+		return nodeFinishedTicks[precedingTaskIndex].load(std::memory_order_acquire) > tick;
+	});
+}
+
+void TaskManager::runChildTask(unsigned int workerIndex, unsigned int childTaskIndex)
+{
+	ChildTask* child = &childTask(childTaskIndex);
+
+	RunningTask currentTask{ this, workerIndex, childTaskIndex | CHILD_TASK_FLAG, child->slot, child->priority, &child->joinCounter, false };
+	RunningTask* previousTask = runningTask;
+	runningTask = &currentTask;
+	child->task();
+	runningTask = previousTask;
+
+	if (currentTask.spawnedChildren && child->joinCounter.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+	// Going up while the finished child was the last part of its parent.
+	while (true)
+	{
+		const unsigned int parentEntry = child->parentEntry;
+		child->task = nullptr;
+		{
+			std::lock_guard<std::mutex> lg(childTasksLock);
+			freeChildTasks.push_back(childTaskIndex);
+		}
+
+		if (!(parentEntry & CHILD_TASK_FLAG))
+		{
+			const unsigned int taskIndex = parentEntry >> TICK_SLOT_BITS;
+			const unsigned int slot = parentEntry & (MAX_PIPELINE_DEPTH - 1);
+			if (nodeJoinCounters[slot * runtimeTasks.size() + taskIndex].fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+			const unsigned int nextQueueEntry = finishNode(workerIndex, taskIndex, slot);
+			if (nextQueueEntry != 0) runTask(workerIndex, nextQueueEntry);
+			return;
+		}
+
+		childTaskIndex = parentEntry & ~CHILD_TASK_FLAG;
+		child = &childTask(childTaskIndex);
+		if (child->joinCounter.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+	}
+}
+
+void TaskManager::spawn(const InlineFunction<void()>& task)
+{
+	if (!runningTask || runningTask->taskManager != this) throw std::logic_error("Child tasks can only be spawned from a running task of the same TaskManager.");
+
+	unsigned int childTaskIndex;
+	{
+		std::lock_guard<std::mutex> lg(childTasksLock);
+		if (freeChildTasks.empty() && numberOfChildTaskBlocks < MAX_CHILD_TASK_BLOCKS)
+		{
+			childTaskBlocks[numberOfChildTaskBlocks].reset(new ChildTask[CHILD_TASK_BLOCK_SIZE]);
+			for (unsigned int i = CHILD_TASK_BLOCK_SIZE; i > 0; i--) freeChildTasks.push_back(numberOfChildTaskBlocks * CHILD_TASK_BLOCK_SIZE + i - 1);
+			numberOfChildTaskBlocks++;
+		}
+
+		if (freeChildTasks.empty())
+		{
+			childTaskIndex = CHILD_TASK_FLAG;
+		}
+		else
+		{
+			childTaskIndex = freeChildTasks.back();
+			freeChildTasks.pop_back();
+		}
+	}
+
+	// Out of room, the parent waits for it anyway.
+	if (childTaskIndex == CHILD_TASK_FLAG)
+	{
+		task();
+		return;
 	}
 
-	taskDependencyGraph.init(dependencies);
+	ChildTask& child = childTask(childTaskIndex);
+	child.task = task;
+	child.parentEntry = runningTask->queueEntry;
+	child.slot = runningTask->slot;
+	child.priority = runningTask->priority;
+
+	// The parent holds one extra count until it's done running, so that children finishing early can't finish it.
+	runningTask->joinCounter->fetch_add(runningTask->spawnedChildren ? 1 : 2, std::memory_order_relaxed);
+	runningTask->spawnedChildren = true;
+
+	taskQueue->push(runningTask->workerIndex, queueEntryOwner | childTaskIndex | CHILD_TASK_FLAG, child.priority);
+}
+
+FrameArena& TaskManager::getFrameArena()
+{
+	if (!runningTask || runningTask->taskManager != this) throw std::logic_error("The frame arena can only be used from a running task of the same TaskManager.");
+
+	return *frameArenas[runningTask->slot * numberOfWorkers + runningTask->workerIndex];
 }
 
 void TaskManager::run()
 {
-	isDone = false;
+	applyTaskChanges();
+
+	// Helping the pool instead of sleeping until the last task of the tick is done, if the executor has room for it.
+	// This runs the tasks of any TaskManager using the executor.
+	const unsigned int workerIndex = executor->acquireHelperIndex();
+	if (workerIndex == EXTERNAL_WORKER_INDEX && executor->getNumberOfThreads() == 1)
+		throw std::logic_error("Without a pool, only " + std::to_string(MAX_HELPING_THREADS) + " threads can run ticks at the same time.");
+
+	std::future<void> result;
+	const unsigned int slot = startTick(result, workerIndex != EXTERNAL_WORKER_INDEX);
+
+	if (workerIndex != EXTERNAL_WORKER_INDEX)
+	{
+		std::uint64_t queueEntry;
+		while (taskQueue->pop(workerIndex, queueEntry, slotsFinished[slot])) executor->runTask(workerIndex, queueEntry);
+		executor->releaseHelperIndex(workerIndex);
+	}
+
+	result.wait();
+}
+
+std::future<void> TaskManager::runAsync()
+{
+	// Without a pool, nothing else would run the tick.
+	if (executor->getNumberOfThreads() == 1)
+	{
+		run();
+		std::promise<void> promise;
+		promise.set_value();
+		return promise.get_future();
+	}
+
+	applyTaskChanges();
+
+	std::future<void> result;
+	startTick(result, false);
+	return result;
+}
+
+unsigned int TaskManager::startTick(std::future<void>& result, bool callerHelps)
+{
 	std::unique_lock<std::mutex> ul(lock);
-	taskQueue.push(FIRST_TASK_INDEX);
-	cv.wait(ul, [&]() { return isDone; });
+	cv.wait(ul, [&]() { return numberOfTicksStarted - numberOfTicksFinished < settings.pipelineDepth; });
+
+	const unsigned int slot = static_cast<unsigned int>(numberOfTicksStarted % settings.pipelineDepth);
+	slotTicks[slot] = numberOfTicksStarted++;
+	slotPromises[slot] = std::promise<void>();
+	slotStartTimes[slot] = std::chrono::steady_clock::now();
+	slotsFinished[slot] = false;
+	slotCallerHelps[slot] = callerHelps;
+	result = slotPromises[slot].get_future();
+
+	// Once the durations drifted away from the plan, the ticks go back to being scheduled as their tasks get unlocked.
+	const bool useStaticSchedule = !staticSchedule.empty() && !staticScheduleDrifted;
+	slotsStaticallyScheduled[slot].store(useStaticSchedule, std::memory_order_relaxed);
+	ul.unlock();
+
+	ReleasedNodes releasedNodes;
+	if (useStaticSchedule)
+	{
+		// Every list runs on whichever thread picks it up, and goes on until it has to wait for another list.
+		for (unsigned int list = 0; list < staticSchedule.size(); list++)
+		{
+			if (staticSchedule[list].empty()) continue;
+
+			if (releasedNodes.numberOfNodes == RELEASE_BATCH_SIZE) pushReleasedNodes(EXTERNAL_WORKER_INDEX, releasedNodes);
+			releasedNodes.queueEntries[releasedNodes.numberOfNodes] = queueEntryOwner | STATIC_SCHEDULE_FLAG | list;
+			releasedNodes.priorities[releasedNodes.numberOfNodes] = nodePriorities[staticSchedule[list].front()];
+			releasedNodes.numberOfNodes++;
+		}
+		pushReleasedNodes(EXTERNAL_WORKER_INDEX, releasedNodes);
+		return slot;
+	}
+
+	// The first task of this tick might still be waiting for the one of the previous tick.
+	taskDependencyGraph.startTask(FIRST_TASK_INDEX, slot, [&](unsigned int index, unsigned int unlockedSlot)
+	{
+		releaseNode(EXTERNAL_WORKER_INDEX, index, unlockedSlot, releasedNodes);
+	});
+	finishSkippedNodes(EXTERNAL_WORKER_INDEX, releasedNodes);
+	pushReleasedNodes(EXTERNAL_WORKER_INDEX, releasedNodes);
+
+	return slot;
+}
+
+void TaskManager::finishTick(unsigned int slot)
+{
+	std::promise<void> promise;
+	bool callerHelps;
+	{
+		std::lock_guard<std::mutex> lg(lock);
+		promise = std::move(slotPromises[slot]);
+		callerHelps = slotCallerHelps[slot];
+
+		lastTickStatistics = TickStatistics();
+		lastTickStatistics.tick = slotTicks[slot];
+		lastTickStatistics.duration = std::chrono::steady_clock::now() - slotStartTimes[slot];
+		lastTickStatistics.staticallyScheduled = slotsStaticallyScheduled[slot].load(std::memory_order_relaxed);
+		float durationDrift = 0.0f;
+		for (unsigned int i = 0; i < numberOfWorkers; i++)
+		{
+			WorkerTickCounters& counters = workerTickCounters[slot * numberOfWorkers + i];
+			lastTickStatistics.numberOfTasksRun += counters.numberOfTasksRun;
+			lastTickStatistics.numberOfTasksSkipped += counters.numberOfTasksSkipped;
+			lastTickStatistics.costOfTasksRun += counters.costOfTasksRun;
+			durationDrift += counters.durationDrift;
+			counters = WorkerTickCounters();
+			lastTickStatistics.frameArenaPeakBytes += frameArenas[slot * numberOfWorkers + i]->reset();
+		}
+		if (lastTickStatistics.staticallyScheduled && durationDrift > settings.staticScheduleDriftThreshold * staticScheduleTotalDuration) staticScheduleDrifted = true;
+
+		numberOfTicksFinished++;
+	}
+	cv.notify_all();
+	promise.set_value();
+
+	// The thread of run() might be waiting for tasks that won't come.
+	if (callerHelps)
+	{
+		slotsFinished[slot] = true;
+		taskQueue->wakeAll();
+	}
+}
+
+void TaskManager::runDynamicRangeChunk(unsigned int taskIndex, unsigned int chunk, unsigned int numberOfChunks) const
+{
+	const TaskInformation& task = tasks[taskIndex];
+	const unsigned int rangeEnd = rangeEnds[runningTask->slot * tasks.size() + taskIndex];
+	const std::uint64_t rangeSize = rangeEnd > task.rangeBegin ? rangeEnd - task.rangeBegin : 0;
+
+	// The shares are rounded so that together they cover the whole range, and they might be empty when it's small.
+	unsigned int begin = task.rangeBegin + static_cast<unsigned int>(rangeSize * chunk / numberOfChunks);
+	const unsigned int end = task.rangeBegin + static_cast<unsigned int>(rangeSize * (chunk + 1) / numberOfChunks);
+	while (begin < end)
+	{
+		const unsigned int pieceEnd = end - begin > task.grainSize ? begin + task.grainSize : end;
+		task.rangeTask(begin, pieceEnd);
+		begin = pieceEnd;
+	}
+}
+
+void TaskManager::compileStaticSchedule()
+{
+	if (settings.pipelineDepth != 1) throw std::logic_error("A static schedule can only be compiled with a pipeline depth of 1.");
+	if (!settings.measureTaskDurations) throw std::logic_error("A static schedule can only be compiled when the task durations are measured.");
+
+	// The tick that was just waited for might still be retiring.
+	std::unique_lock<std::mutex> ul(lock);
+	cv.wait(ul, [&]() { return numberOfTicksRetired == numberOfTicksStarted; });
+
+	// Every executor thread, including the one calling run(), can pick up a list.
+	const unsigned int numberOfLists = std::min(executor->getNumberOfThreads(), MAX_STATIC_SCHEDULE_WORKERS);
+	staticSchedule = taskDependencyGraph.computeListSchedule(nodeDurations, numberOfLists);
+	for (auto& list : staticSchedule) list.erase(std::remove(list.begin(), list.end(), DUMMY_TASK_INDEX), list.end());
+
+	staticScheduleDurations = nodeDurations;
+	staticScheduleTotalDuration = std::accumulate(nodeDurations.begin(), nodeDurations.end(), 0.0f);
+	staticScheduleDrifted = false;
+}
+
+void TaskManager::clearStaticSchedule()
+{
+	std::unique_lock<std::mutex> ul(lock);
+	cv.wait(ul, [&]() { return numberOfTicksRetired == numberOfTicksStarted; });
+
+	staticSchedule.clear();
+	staticScheduleDrifted = false;
+}
+
+TickStatistics TaskManager::getLastTickStatistics() const
+{
+	std::lock_guard<std::mutex> lg(lock);
+	return lastTickStatistics;
+}
+
+void TaskManager::setTracingEnabled(bool enabled)
+{
+	taskTracer.setEnabled(enabled);
+}
+
+void TaskManager::writeChromeTrace(std::ostream& output) const
+{
+	taskTracer.writeChromeTrace(output, [&](unsigned int taskIndex) { return tasks[nodeTaskIndices[taskIndex]].name; });
 }
@@ -1,12 +1,22 @@
 #pragma once
 
+#include "FrameArena.h"
+#include "InlineFunction.h"
 #include "TaskDependencyGraph.h"
+#include "TaskExecutor.h"
 #include "TaskQueue.h"
+#include "TaskTracer.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <mutex>
+#include <ostream>
 #include <string>
-#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define FIRST_TASK_IDENTIFIER "__first"
@@ -17,42 +27,444 @@
 #define FIRST_TASK_INDEX 1
 #define LAST_TASK_INDEX 2
 
-const unsigned int NUMBER_OF_THREADS = std::thread::hardware_concurrency();
+// Queue entries hold the index of the task in the upper bits, and the slot of the tick it belongs to in the lower ones.
+#define TICK_SLOT_BITS 8
+#define MAX_PIPELINE_DEPTH (1u << TICK_SLOT_BITS)
+
+// Queue entries with this bit set hold the index of a spawned child task instead.
+#define CHILD_TASK_FLAG 0x80000000u
+
+// Queue entries with this bit set resume a worker's list of a static schedule, at the position in the bits above
+// STATIC_SCHEDULE_WORKER_BITS, with the index of the list in the bits below.
+#define STATIC_SCHEDULE_FLAG 0x40000000u
+#define STATIC_SCHEDULE_WORKER_BITS 8
+#define MAX_STATIC_SCHEDULE_WORKERS (1u << STATIC_SCHEDULE_WORKER_BITS)
+
+// The most nodes a graph can have, counting the chunks of the range tasks, so that the index of a node
+// in a queue entry stays clear of the flags above.
+#define MAX_NUMBER_OF_NODES (STATIC_SCHEDULE_FLAG >> TICK_SLOT_BITS)
+
+// Weight of the newest measurement in the moving average of the duration of every task.
+#define TASK_DURATION_SMOOTHING 0.1f
+
+// A measurement counts as at most this many times the average, since a thread that gets preempted in the middle
+// of a task makes it look much longer than it is. A task that really got slower still gets there in a few ticks.
+#define MAX_TASK_DURATION_GROWTH 4.0f
+
+// Child tasks are stored in blocks of this size, up to a limit of blocks. Spawning past the limit runs the child right away.
+#define CHILD_TASK_BLOCK_SIZE 1024
+#define MAX_CHILD_TASK_BLOCKS 1024
+
+// Lets the TaskManager choose the phase of a periodic task.
+#define AUTOMATIC_PHASE 0xFFFFFFFFu
+
+// The longest cycle of ticks that is looked at when spreading periodic tasks.
+#define MAX_PHASE_CYCLE 1024
+
+// The most nodes that get pushed to the queue at once when a task unlocks them.
+#define RELEASE_BATCH_SIZE 32
+
+// The chunks per worker that a range task whose end is read every tick gets split into, see TaskInformation::getRangeEnd.
+#define DYNAMIC_RANGE_CHUNKS_PER_WORKER 4
+
+// The number of tasks whose dependencies are looked at together when removing the redundant ones, a multiple of 64.
+#define TRANSITIVE_REDUCTION_BLOCK_SIZE 1024
+
+struct TaskManagerSettings
+{
+	// Only used when the TaskManager isn't given an executor and starts its own, see TaskExecutorSettings.
+	SchedulingMode schedulingMode = SchedulingMode::Mailbox;
+	unsigned int numberOfThreads = NUMBER_OF_THREADS;
+	unsigned int spinIterations = DEFAULT_SPIN_ITERATIONS;
+
+	// How many ticks can be in flight at the same time, up to MAX_PIPELINE_DEPTH.
+	// With more than 1, a task of the next tick can start as soon as its own preceding tasks of that tick are done,
+	// even if unrelated tasks of the previous tick are still running. A task never overlaps with itself,
+	// and never starts before its dependants from the previous tick are done with what it produced.
+	unsigned int pipelineDepth = 1;
+
+	// Runs chains of tasks, where every task is the only one waiting for the previous one and waits for nothing else,
+	// back to back on the thread that runs the first one instead of going through the queue for every link.
+	// The tasks keep their own names in the trace and count on their own in the statistics.
+	bool fuseChains = false;
+
+	// The thread that finishes a task keeps one of the tasks it unlocks and runs it right away, while its data is still
+	// in the cache. The others go to the queue as usual. The kept task is the one with the longest chain of tasks
+	// waiting behind it, or the fused one if there's any.
+	bool inlineContinuations = false;
+
+	// Keeps a moving average of how long every task takes, which compileStaticSchedule() plans with.
+	bool measureTaskDurations = false;
+
+	// How far the measured durations of the tasks can get from the ones a static schedule was planned with, added up
+	// and relative to the planned work of a whole tick, before the ticks go back to dynamic scheduling.
+	// Looking at the whole tick keeps a task that got interrupted once from throwing the plan away.
+	float staticScheduleDriftThreshold = 0.5f;
+
+	// The size of the first block of the frame arena every thread has for every tick slot, see getFrameArena().
+	// The arenas grow by themselves when a tick needs more.
+	std::size_t frameArenaSize = DEFAULT_FRAME_ARENA_SIZE;
+};
 
 struct TaskInformation
 {
-	std::function<void()> task;
+	// Gets copied into the tick's task table, so whatever it captures must fit in INLINE_FUNCTION_SIZE bytes.
+	InlineFunction<void()> task;
 	std::string name;
 	std::vector<std::string> precedingTasks;
+
+	// Names of the data this task reads and writes, they can be anything. Tasks that use the same resource get
+	// ordered as they were added: readers wait for the previous writer, and writers wait for the previous writer
+	// and for every reader since. Readers of the same resource can run at the same time.
+	std::vector<std::string> readResources;
+	std::vector<std::string> writtenResources;
+
+	// Data-parallel tasks set this instead of task. The range [rangeBegin, rangeEnd) gets split into
+	// chunks of grainSize indices that run on any thread, and this is called with the bounds of each chunk.
+	// The tasks that depend on this one only run after every chunk has finished.
+	// The range is split once, when the graph is generated, so it has to stay the same for as long as the graph is used.
+	InlineFunction<void(unsigned int, unsigned int)> rangeTask;
+	unsigned int rangeBegin = 0;
+	unsigned int rangeEnd = 0;
+	unsigned int grainSize = 1;
+
+	// For ranges that change from tick to tick, like the elements of a container that grows and shrinks. When set, it's
+	// called in every tick once the task is ready to run, and what it returns is used instead of rangeEnd. The range then
+	// gets split evenly into DYNAMIC_RANGE_CHUNKS_PER_WORKER chunks per worker, and every chunk calls rangeTask with
+	// pieces of up to grainSize indices.
+	InlineFunction<unsigned int()> getRangeEnd;
+
+	// Roughly how long the task takes compared to the others, in any unit. Only used by SchedulingMode::CriticalPath
+	// to find the longest chains of tasks, and to spread periodic tasks. For range tasks it's the cost of the whole range.
+	float cost = 1.0f;
+
+	// Slow-changing tasks can run once every period ticks, on the ticks whose number modulo the period is the phase.
+	// On the other ticks they are done as soon as they are ready, without running. With AUTOMATIC_PHASE the
+	// phases get chosen so that the cost of the periodic tasks is spread evenly over the ticks.
+	unsigned int period = 1;
+	unsigned int phase = AUTOMATIC_PHASE;
+
+	// Keeps the task out of fused chains, so that it always goes through the queue on its own.
+	bool isolated = false;
+};
+
+// What happened during a tick.
+struct TickStatistics
+{
+	// The number of the tick, starting at 0.
+	std::uint64_t tick = 0;
+
+	// From the start of the tick until its last task finished.
+	std::chrono::nanoseconds duration{ 0 };
+
+	// The tasks that ran, and the periodic tasks that were skipped because it wasn't their turn.
+	unsigned int numberOfTasksRun = 0;
+	unsigned int numberOfTasksSkipped = 0;
+
+	// The sum of the cost of the tasks that ran.
+	float costOfTasksRun = 0.0f;
+
+	// Whether the tick replayed a static schedule instead of being scheduled as the tasks became ready.
+	bool staticallyScheduled = false;
+
+	// The most memory the tasks took from the frame arenas at once, added up over every thread.
+	std::size_t frameArenaPeakBytes = 0;
 };
 
 class TaskManager
 {
 public:
-	// Initializes threads and internal tasks.
-	TaskManager();
+	// Initializes internal tasks. The tasks run on the given executor, which can be shared with other TaskManagers,
+	// or on an executor of its own made from the settings.
+	// Throws std::invalid_argument if the pipeline depth or the number of threads is out of range.
+	TaskManager(const TaskManagerSettings& settings = TaskManagerSettings(), std::shared_ptr<TaskExecutor> executor = nullptr);
 
-	// Must join all the threads.
+	// Waits for the ticks in flight.
 	~TaskManager();
 
-	// Adds a task to the system, must be called before generateDependencyGraph().
+	// Adds a task to the system. Once the graph is generated, the task is staged instead, see removeTask().
+	// Throws std::invalid_argument if there's already a task with the same name, or if it's not a valid task.
 	void addTask(const TaskInformation& taskInformation);
 
-	// Generates the graph and allows for run() to be called.
+	// Removes a task from the system. Once the graph is generated, the removal is staged along with the added tasks,
+	// and they are applied in order when the next tick starts, so this can be called from anywhere, even from a running
+	// task. The ticks in flight finish with the graph they started with, and the threads keep running.
+	// Throws std::invalid_argument if the task doesn't exist or is one of the internal tasks.
+	void removeTask(const std::string& name);
+
+	// Generates the graph and allows for run() to be called. Dependencies come from the preceding tasks and
+	// the resources of every task, and the ones already implied by others are dropped.
+	// Throws std::invalid_argument if a task depends on one that doesn't exist, if there's a dependency cycle,
+	// or if the tasks and the chunks of the range tasks add up to more than MAX_NUMBER_OF_NODES.
 	void generateDependencyGraph();
 
 	// Runs all the tasks in the correct order. Must have run generateDependencyGraph() before.
+	// The calling thread runs tasks alongside the pool until the tick is over, as long as the executor
+	// has fewer than MAX_HELPING_THREADS doing the same. Throws std::logic_error if it has no pool and
+	// there are already that many.
+	// Applies the staged changes to the tasks first. Throws std::invalid_argument if they don't make a valid graph,
+	// in which case they are dropped and the previous tasks are kept.
 	void run();
 
+	// Starts a tick and returns a future that becomes ready when the tick is over.
+	// Blocks first if there are already as many ticks in flight as the pipeline depth.
+	// If the executor has no pool, the tick is run on the calling thread, like run() does, before returning.
+	// Applies the staged changes to the tasks first. Throws std::invalid_argument if they don't make a valid graph,
+	// in which case they are dropped and the previous tasks are kept.
+	std::future<void> runAsync();
+
+	// Can only be called from a running task, to add work to it that can run on any thread. The tasks that depend on
+	// the running task wait for its children too, and children can spawn their own. They go to the queue of the
+	// thread that spawns them first.
+	// Throws std::logic_error if the calling thread isn't running a task of this TaskManager.
+	void spawn(const InlineFunction<void()>& task);
+
+	// Can only be called from a running task, returns the frame arena of the calling thread for the tick being run.
+	// Allocating from it doesn't lock, and everything allocated is released at once when the tick is over,
+	// so it suits scratch data that doesn't outlive the tick. With FrameAllocator it works with standard containers.
+	// Throws std::logic_error if the calling thread isn't running a task of this TaskManager.
+	FrameArena& getFrameArena();
+
+	// Returns the statistics of the last tick that finished.
+	TickStatistics getLastTickStatistics() const;
+
+	// Plans from the measured durations which tasks every thread runs and in which order, so that the next ticks
+	// replay the plan instead of going through the queue for every task. The threads only wait for the tasks
+	// of the other threads they depend on. The ticks go back to dynamic scheduling by themselves if the durations
+	// drift too far from the plan, until this is called again. Waits for the ticks in flight to be over.
+	// Throws std::logic_error if the durations aren't measured or if the pipeline depth isn't 1.
+	void compileStaticSchedule();
+
+	// Goes back to dynamic scheduling. Waits for the ticks in flight to be over.
+	void clearStaticSchedule();
+
+	// The executor running the tasks, which also knows how long its workers wait for them.
+	const std::shared_ptr<TaskExecutor>& getExecutor() const { return executor; }
+
+	// Starts or stops recording the timeline of every task execution.
+	// Does nothing unless TASK_MANAGER_TRACING is set to 1.
+	void setTracingEnabled(bool enabled);
+
+	// Writes the recorded timeline in Chrome's trace_event format. Should be called between ticks.
+	// Only the ticks since the graph was last generated are in it, the ones before ran a different graph.
+	void writeChromeTrace(std::ostream& output) const;
+
 private:
-	Mailbox taskQueue;
+	friend class TaskExecutor;
+
+	static unsigned int toQueueEntry(unsigned int taskIndex, unsigned int slot) { return taskIndex << TICK_SLOT_BITS | slot; }
+
+	// Periodic tasks are skipped on the ticks that aren't their turn.
+	bool isSkipped(unsigned int taskIndex, unsigned int slot) const { return nodePeriods[taskIndex] > 1 && slotTicks[slot] % nodePeriods[taskIndex] != nodePhases[taskIndex]; }
+
+	// Runs a task popped from the queue and releases the ones waiting for it, followed by the tasks it kept to run next.
+	void runTask(unsigned int workerIndex, unsigned int queueEntry);
+
+	// Runs a single node. Returns the queue entry of the node to run next on this thread, or 0 if there's none.
+	unsigned int runNode(unsigned int workerIndex, unsigned int queueEntry);
+
+	// Runs the task of a node and measures it. Returns false if its children are still running,
+	// then the last one to finish finishes the node.
+	bool executeNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot);
+
+	// Runs a list of the static schedule from a position, until it's over or it has to wait for another list.
+	void runStaticSchedule(unsigned int workerIndex, unsigned int queueEntry);
+
+	// Lets the static schedule know that a node is done, and queues the lists that were waiting for it.
+	void finishScheduledNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot);
+
+	// Whether everything a node waits for within the tick is done, in a tick replaying the static schedule.
+	bool arePrecedingTasksFinished(unsigned int taskIndex, std::uint64_t tick) const;
+
+	// The nodes released together, pushed to the queue all at once so that the right number of workers wake up.
+	struct ReleasedNodes
+	{
+		std::uint64_t queueEntries[RELEASE_BATCH_SIZE];
+		float priorities[RELEASE_BATCH_SIZE];
+		unsigned int numberOfNodes = 0;
+
+		// The queue entries of the released nodes that skip this tick, still to be finished by finishSkippedNodes().
+		std::vector<unsigned int> skippedNodes;
+	};
+
+	// Adds a node that became ready to the batch, or to its skipped nodes if it's periodic and this isn't its tick.
+	void releaseNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot, ReleasedNodes& releasedNodes);
+
+	// Finishes the skipped nodes of the batch one after the other, along with the ones they release in turn,
+	// so that a long chain of them can't overflow the stack.
+	void finishSkippedNodes(unsigned int workerIndex, ReleasedNodes& releasedNodes);
+
+	// Adds a queue entry to the batch, pushing the batch first if it's full.
+	void queueNode(unsigned int workerIndex, unsigned int queueEntry, ReleasedNodes& releasedNodes);
+
+	// Pushes the batch to the queue and empties it.
+	void pushReleasedNodes(unsigned int workerIndex, ReleasedNodes& releasedNodes);
+
+	// Releases the tasks waiting for a node, once it and its children are done.
+	// The node fused after it, or the continuation, isn't queued but returned as a queue entry to run right away.
+	// Returns 0, the entry of the dummy task, if there's none.
+	unsigned int finishNode(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot);
+
+	// Runs a spawned task, and finishes its parent if it was the last part of it.
+	void runChildTask(unsigned int workerIndex, unsigned int childTaskIndex);
+
+	// Runs one of the chunks of a range task whose end is read every tick, on the calling worker's running task.
+	void runDynamicRangeChunk(unsigned int taskIndex, unsigned int chunk, unsigned int numberOfChunks) const;
+
+	// Waits for the ticks in flight and applies the staged changes to the tasks, if there's any.
+	// If they don't make a valid graph they are dropped and the previous graph is generated again,
+	// before throwing the error of generateDependencyGraph().
+	void applyTaskChanges();
+
+	// Adds a task, or removes one by name, without checking the task itself.
+	void insertTask(const TaskInformation& taskInformation);
+	void eraseTask(const std::string& name);
+
+	// Waits for a free slot and starts the tick in it. Returns the slot.
+	unsigned int startTick(std::future<void>& result, bool callerHelps);
+
+	// Lets the world know that the tick in a slot is over.
+	void finishTick(unsigned int slot);
+
+	struct Dependency
+	{
+		unsigned int precedingTask;
+		unsigned int task;
+	};
+
+	// Gathers the dependencies written by hand and the ones coming from resources.
+	// crossTickDependencies get the tasks of the next tick that have to wait for a task of the previous one.
+	// Returns the description of the errors found, if any.
+	std::string collectDependencies(std::vector<Dependency>& dependencies, std::vector<Dependency>& crossTickDependencies) const;
+
+	// Removes duplicated dependencies, and the ones that are already implied by others.
+	static void removeRedundantDependencies(unsigned int numberOfTasks, std::vector<Dependency>& dependencies);
+
+	// Returns the phase of every task, choosing the automatic ones so that the heaviest ticks are as light as possible.
+	std::vector<unsigned int> choosePhases() const;
+
+	const TaskManagerSettings settings;
+	const std::shared_ptr<TaskExecutor> executor;
+	const unsigned int numberOfWorkers;
+	TaskQueue* const taskQueue;
 	TaskDependencyGraph taskDependencyGraph;
+	TaskTracer taskTracer;
+
+	// Goes in the upper bits of everything this TaskManager pushes to the executor's queue.
+	std::uint64_t queueEntryOwner;
+	unsigned int taskManagerIndex;
 
-	bool beingDestroyed = false;
 	std::vector<TaskInformation> tasks;
-	std::vector<std::thread> threadPool;
+	std::unordered_map<std::string, unsigned int> taskIndices;
+
+	// Tasks added or removed after the graph was generated, in order, waiting for the next tick. Guarded by the lock.
+	struct TaskChange
+	{
+		TaskInformation task;
+		bool removed;
+	};
+	std::vector<TaskChange> taskChanges;
+	bool graphGenerated = false;
+
+	// What actually gets scheduled, kept apart from the names and the rest of the build-time information
+	// so that running a node only touches its own cache line. Every task gets the node with its own index,
+	// and range tasks that need splitting get one extra node that starts them plus one node per chunk.
+	struct alignas(64) RuntimeTask
+	{
+		InlineFunction<void()> task;
+	};
+	std::vector<RuntimeTask> runtimeTasks;
+
+	// The index of the task every node was generated from.
+	std::vector<unsigned int> nodeTaskIndices;
+
+	// For every slot and task, where the range of the task ends in that tick, for the range tasks that read it every tick.
+	// Written by the node that starts the range before its chunks are released.
+	std::vector<unsigned int> rangeEnds;
+
+	// How soon every node should run once it's ready, higher first.
+	std::vector<float> nodePriorities;
+
+	// The period and phase of the task of every node, and its share of the task's cost.
+	std::vector<unsigned int> nodePeriods;
+	std::vector<unsigned int> nodePhases;
+	std::vector<float> nodeCosts;
+
+	// The node that runs right after every node on the same thread when they are fused in a chain, or DUMMY_TASK_INDEX.
+	std::vector<unsigned int> nodeChainSuccessors;
+
+	// The moving average of how long every node took in nanoseconds. A node never runs twice at the same time,
+	// so only one thread writes it at once.
+	std::vector<float> nodeDurations;
+
+	// The nodes every list of the static schedule runs in order, the durations it was planned with and their sum.
+	std::vector<std::vector<unsigned int>> staticSchedule;
+	std::vector<float> staticScheduleDurations;
+	float staticScheduleTotalDuration = 0.0f;
+	bool staticScheduleDrifted = false;
+
+	// The number of the last tick every node finished in plus one, in the ticks replaying the static schedule.
+	std::unique_ptr<std::atomic<std::uint64_t>[]> nodeFinishedTicks;
+
+	// The queue entry of the list waiting for a node to be ready, or 0.
+	std::unique_ptr<std::atomic<unsigned int>[]> nodeWaitingLists;
+
+	// For every slot and node, how many children are left plus one while the node is still running.
+	// Only used by the nodes that spawn.
+	std::unique_ptr<std::atomic<unsigned int>[]> nodeJoinCounters;
+
+	struct ChildTask
+	{
+		InlineFunction<void()> task;
+
+		// The queue entry of the node or child that spawned this one, and the slot of the tick it belongs to.
+		unsigned int parentEntry;
+		unsigned int slot;
+		float priority;
+
+		// Same as the join counters of the nodes.
+		std::atomic<unsigned int> joinCounter{ 0 };
+	};
+	ChildTask& childTask(unsigned int childTaskIndex) const { return childTaskBlocks[childTaskIndex / CHILD_TASK_BLOCK_SIZE][childTaskIndex % CHILD_TASK_BLOCK_SIZE]; }
+
+	// The blocks never move, so that children can be read without locking. Only allocating and freeing them locks.
+	std::unique_ptr<std::unique_ptr<ChildTask[]>[]> childTaskBlocks;
+	unsigned int numberOfChildTaskBlocks = 0;
+	std::vector<unsigned int> freeChildTasks;
+	std::mutex childTasksLock;
+
+	// Every tick in flight uses the slot of its number modulo the pipeline depth. A tick is retired once
+	// its last task is done releasing the next tick, nothing of it touches the TaskManager after that.
+	std::uint64_t numberOfTicksStarted = 0;
+	std::uint64_t numberOfTicksFinished = 0;
+	std::uint64_t numberOfTicksRetired = 0;
+	std::vector<std::uint64_t> slotTicks;
+	std::vector<std::promise<void>> slotPromises;
+	std::vector<std::chrono::steady_clock::time_point> slotStartTimes;
+
+	// What every worker did in every slot, added up when the tick is over. Every task of a tick finishes
+	// before its last task does, so these don't need to be atomic.
+	struct alignas(64) WorkerTickCounters
+	{
+		unsigned int numberOfTasksRun = 0;
+		unsigned int numberOfTasksSkipped = 0;
+		float costOfTasksRun = 0.0f;
+
+		// How far the nodes' durations are from the static schedule's, in nanoseconds.
+		float durationDrift = 0.0f;
+	};
+	std::vector<WorkerTickCounters> workerTickCounters;
+	TickStatistics lastTickStatistics;
+
+	// One per worker for every slot, in the same order as the counters. They are reset once the tick in the slot is over.
+	std::vector<std::unique_ptr<FrameArena>> frameArenas;
+
+	// Set when the tick in a slot is over, to stop the thread of run() from taking more tasks.
+	std::unique_ptr<std::atomic<bool>[]> slotsFinished;
+	std::vector<bool> slotCallerHelps;
 
-	bool isDone;
-	std::mutex lock;
+	// Whether the tick in a slot replays the static schedule. Read by the workers while other slots get started.
+	std::unique_ptr<std::atomic<bool>[]> slotsStaticallyScheduled;
+	mutable std::mutex lock;
 	std::condition_variable cv;
 };
@@ -1,17 +1,343 @@
 #include "TaskQueue.h"
 
-void Mailbox::push(unsigned int taskIndex)
+#include <algorithm>
+
+TaskQueue::TaskQueue(unsigned int numberOfWorkers, unsigned int spinIterations) :
+	numberOfWorkers(numberOfWorkers),
+	spinIterations(spinIterations),
+	idleCounters(new IdleCounters[numberOfWorkers])
 {
-	std::lock_guard<std::mutex> lg(lock);
-	queuedTasks.push_back(taskIndex);
-	cv.notify_one();
 }
 
-unsigned int Mailbox::pop()
+IdleStatistics TaskQueue::getIdleStatistics(unsigned int workerIndex) const
+{
+	const IdleCounters& counters = idleCounters[workerIndex];
+
+	IdleStatistics idleStatistics;
+	idleStatistics.spinningTime = std::chrono::nanoseconds(counters.spinningTime.load(std::memory_order_relaxed));
+	idleStatistics.parkedTime = std::chrono::nanoseconds(counters.parkedTime.load(std::memory_order_relaxed));
+	idleStatistics.numberOfSpins = counters.numberOfSpins.load(std::memory_order_relaxed);
+	idleStatistics.numberOfParks = counters.numberOfParks.load(std::memory_order_relaxed);
+	return idleStatistics;
+}
+
+void TaskQueue::addParkedTime(unsigned int workerIndex, std::chrono::steady_clock::time_point parkTime)
+{
+	if (workerIndex >= numberOfWorkers) return;
+	add(idleCounters[workerIndex].parkedTime, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - parkTime).count());
+}
+
+LockedTaskQueue::LockedTaskQueue(unsigned int numberOfWorkers, unsigned int spinIterations) :
+	TaskQueue(numberOfWorkers, spinIterations)
+{
+}
+
+void LockedTaskQueue::push(unsigned int workerIndex, std::uint64_t taskIndex, float priority)
+{
+	push(workerIndex, &taskIndex, &priority, 1);
+}
+
+void LockedTaskQueue::push(unsigned int, const std::uint64_t* taskIndices, const float* priorities, unsigned int numberOfTasks)
 {
+	unsigned int numberOfWakeups;
+	{
+		std::lock_guard<std::mutex> lg(lock);
+		for (unsigned int i = 0; i < numberOfTasks; i++) addTask(taskIndices[i], priorities[i]);
+		numberOfQueuedTasks.store(numberOfQueuedTasks.load(std::memory_order_relaxed) + numberOfTasks, std::memory_order_relaxed);
+		numberOfWakeups = reserveWakeups(numberOfTasks);
+	}
+
+	// The workers that are still spinning don't need anything, they see the new tasks by themselves.
+	for (unsigned int i = 0; i < numberOfWakeups; i++) cv.notify_one();
+}
+
+bool LockedTaskQueue::pop(unsigned int workerIndex, std::uint64_t& taskIndex, const std::atomic<bool>& stop)
+{
+	spin(workerIndex, stop, [&]() { return numberOfQueuedTasks.load(std::memory_order_relaxed) > 0; });
+
 	std::unique_lock<std::mutex> ul(lock);
-	cv.wait(ul, [&]() { return !queuedTasks.empty(); });
-	const unsigned int taskIndex = queuedTasks.back();
+	if (numberOfQueuedTasks.load(std::memory_order_relaxed) == 0 && !stop)
+	{
+		// Every wake up uses one of the pending ones, even a spurious one, so that a notification is never counted
+		// as pending when no parked worker is left to get it.
+		const auto parkTime = std::chrono::steady_clock::now();
+		numberOfParkedWorkers++;
+		do
+		{
+			cv.wait(ul);
+			if (numberOfPendingWakeups > 0) numberOfPendingWakeups--;
+		}
+		while (numberOfQueuedTasks.load(std::memory_order_relaxed) == 0 && !stop);
+		numberOfParkedWorkers--;
+		addParkedTime(workerIndex, parkTime);
+	}
+	if (stop) return false;
+
+	taskIndex = takeTask();
+	numberOfQueuedTasks.store(numberOfQueuedTasks.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+	// A worker woken up for a task that someone else took passes the wake up on if there are still tasks.
+	if (numberOfQueuedTasks.load(std::memory_order_relaxed) > 0 && reserveWakeups(1) > 0) cv.notify_one();
+	return true;
+}
+
+void LockedTaskQueue::wakeAll()
+{
+	// Going through the lock so that a worker can't miss the stop between checking it and waiting.
+	{
+		std::lock_guard<std::mutex> lg(lock);
+	}
+	cv.notify_all();
+}
+
+unsigned int LockedTaskQueue::reserveWakeups(unsigned int numberOfTasks)
+{
+	const unsigned int numberOfIdleWorkers = numberOfParkedWorkers - numberOfPendingWakeups;
+	const unsigned int numberOfWakeups = numberOfTasks < numberOfIdleWorkers ? numberOfTasks : numberOfIdleWorkers;
+	numberOfPendingWakeups += numberOfWakeups;
+	return numberOfWakeups;
+}
+
+void Mailbox::addTask(std::uint64_t taskIndex, float)
+{
+	queuedTasks.push_back(taskIndex);
+}
+
+std::uint64_t Mailbox::takeTask()
+{
+	const std::uint64_t taskIndex = queuedTasks.back();
 	queuedTasks.pop_back();
 	return taskIndex;
 }
+
+void PriorityMailbox::addTask(std::uint64_t taskIndex, float priority)
+{
+	queuedTasks.push_back({ priority, taskIndex });
+	std::push_heap(queuedTasks.begin(), queuedTasks.end());
+}
+
+std::uint64_t PriorityMailbox::takeTask()
+{
+	std::pop_heap(queuedTasks.begin(), queuedTasks.end());
+	const std::uint64_t taskIndex = queuedTasks.back().taskIndex;
+	queuedTasks.pop_back();
+	return taskIndex;
+}
+
+FairMailbox::FairMailbox(unsigned int numberOfOwners, unsigned int numberOfWorkers, unsigned int spinIterations) :
+	LockedTaskQueue(numberOfWorkers, spinIterations),
+	queuedTasks(numberOfOwners)
+{
+}
+
+void FairMailbox::addTask(std::uint64_t taskIndex, float)
+{
+	queuedTasks[taskIndex >> 32].push_back(taskIndex);
+}
+
+std::uint64_t FairMailbox::takeTask()
+{
+	// Starting after the owner that was served last.
+	for (unsigned int i = 1; i <= queuedTasks.size(); i++)
+	{
+		const unsigned int owner = (lastOwner + i) % queuedTasks.size();
+		if (queuedTasks[owner].empty()) continue;
+
+		const std::uint64_t taskIndex = queuedTasks[owner].back();
+		queuedTasks[owner].pop_back();
+		lastOwner = owner;
+		return taskIndex;
+	}
+	return 0;
+}
+
+WorkStealingDeque::Buffer::Buffer(std::int64_t capacity) :
+	capacity(capacity),
+	slots(new std::atomic<std::uint64_t>[capacity])
+{
+}
+
+WorkStealingDeque::WorkStealingDeque() :
+	top(0),
+	bottom(0)
+{
+	buffers.emplace_back(new Buffer(64));
+	buffer.store(buffers.back().get(), std::memory_order_relaxed);
+}
+
+void WorkStealingDeque::push(std::uint64_t taskIndex)
+{
+	const std::int64_t b = bottom.load(std::memory_order_relaxed);
+	const std::int64_t t = top.load(std::memory_order_acquire);
+	Buffer* a = buffer.load(std::memory_order_relaxed);
+
+	if (b - t > a->capacity - 1) a = grow(a, b, t);
+
+	a->put(b, taskIndex);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+bool WorkStealingDeque::pop(std::uint64_t& taskIndex)
+{
+	const std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	Buffer* a = buffer.load(std::memory_order_relaxed);
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t t = top.load(std::memory_order_relaxed);
+
+	// The deque was empty.
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	taskIndex = a->get(b);
+	if (t == b)
+	{
+		// This was the last element, so we have to race the thieves for it.
+		const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return won;
+	}
+
+	return true;
+}
+
+bool WorkStealingDeque::steal(std::uint64_t& taskIndex)
+{
+	while (true)
+	{
+		std::int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const std::int64_t b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b) return false;
+
+		Buffer* a = buffer.load(std::memory_order_acquire);
+		taskIndex = a->get(t);
+
+		// Losing the race means someone else took this element, but there might be more.
+		if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return true;
+	}
+}
+
+WorkStealingDeque::Buffer* WorkStealingDeque::grow(Buffer* oldBuffer, std::int64_t bottomIndex, std::int64_t topIndex)
+{
+	buffers.emplace_back(new Buffer(oldBuffer->capacity * 2));
+	Buffer* newBuffer = buffers.back().get();
+	for (std::int64_t i = topIndex; i < bottomIndex; i++) newBuffer->put(i, oldBuffer->get(i));
+	buffer.store(newBuffer, std::memory_order_release);
+	return newBuffer;
+}
+
+WorkStealingQueue::WorkStealingQueue(unsigned int numberOfWorkers, unsigned int spinIterations) :
+	TaskQueue(numberOfWorkers, spinIterations)
+{
+	for (unsigned int i = 0; i < numberOfWorkers; i++) deques.emplace_back(new WorkStealingDeque());
+}
+
+void WorkStealingQueue::push(unsigned int workerIndex, std::uint64_t taskIndex, float priority)
+{
+	push(workerIndex, &taskIndex, &priority, 1);
+}
+
+void WorkStealingQueue::push(unsigned int workerIndex, const std::uint64_t* taskIndices, const float*, unsigned int numberOfTasks)
+{
+	if (workerIndex < deques.size())
+	{
+		for (unsigned int i = 0; i < numberOfTasks; i++) deques[workerIndex]->push(taskIndices[i]);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lg(injectionLock);
+		injectedTasks.insert(injectedTasks.end(), taskIndices, taskIndices + numberOfTasks);
+		numberOfInjectedTasks.fetch_add(numberOfTasks, std::memory_order_relaxed);
+	}
+
+	wakeWorkers(numberOfTasks);
+}
+
+bool WorkStealingQueue::pop(unsigned int workerIndex, std::uint64_t& taskIndex, const std::atomic<bool>& stop)
+{
+	while (true)
+	{
+		bool popped = false;
+		if (spin(workerIndex, stop, [&]() { return popped = tryPop(workerIndex, taskIndex); })) return popped;
+
+		// Announcing that we are going to sleep before checking one last time, so that
+		// a push or a stop that happens in between always sees us and wakes us up.
+		const std::uint64_t epoch = wakeEpoch.load(std::memory_order_acquire);
+		sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		const bool stopped = stop;
+		if (stopped || tryPop(workerIndex, taskIndex))
+		{
+			sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+			return !stopped;
+		}
+
+		{
+			const auto parkTime = std::chrono::steady_clock::now();
+			std::unique_lock<std::mutex> ul(idleLock);
+			idleCv.wait(ul, [&]() { return wakeEpoch.load(std::memory_order_relaxed) != epoch; });
+			addParkedTime(workerIndex, parkTime);
+		}
+		sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+bool WorkStealingQueue::tryPop(unsigned int workerIndex, std::uint64_t& taskIndex)
+{
+	// Our own tasks come first, they are the most likely to still be in the cache.
+	if (workerIndex < deques.size() && deques[workerIndex]->pop(taskIndex)) return true;
+
+	if (numberOfInjectedTasks.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lg(injectionLock);
+		if (!injectedTasks.empty())
+		{
+			taskIndex = injectedTasks.back();
+			injectedTasks.pop_back();
+			numberOfInjectedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Trying every other worker, starting with the next one so that thieves spread out.
+	for (unsigned int i = 1; i <= deques.size(); i++)
+	{
+		const unsigned int victim = (workerIndex + i) % deques.size();
+		if (victim != workerIndex && deques[victim]->steal(taskIndex)) return true;
+	}
+
+	return false;
+}
+
+void WorkStealingQueue::wakeWorkers(unsigned int numberOfTasks)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const unsigned int numberOfSleepingWorkers = sleepingWorkers.load(std::memory_order_relaxed);
+	if (numberOfSleepingWorkers == 0) return;
+
+	{
+		std::lock_guard<std::mutex> lg(idleLock);
+		wakeEpoch.fetch_add(1, std::memory_order_release);
+	}
+
+	// Every sleeping worker would see the new epoch, but only the notified ones wake up to check it.
+	const unsigned int numberOfWakeups = numberOfTasks < numberOfSleepingWorkers ? numberOfTasks : numberOfSleepingWorkers;
+	if (numberOfWakeups == numberOfSleepingWorkers) idleCv.notify_all();
+	else for (unsigned int i = 0; i < numberOfWakeups; i++) idleCv.notify_one();
+}
+
+void WorkStealingQueue::wakeAll()
+{
+	{
+		std::lock_guard<std::mutex> lg(idleLock);
+		wakeEpoch.fetch_add(1, std::memory_order_release);
+	}
+	idleCv.notify_all();
+}
@@ -1,22 +1,279 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
-class Mailbox
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Worker index used by threads that don't belong to the pool (like the world thread) when pushing tasks.
+#define EXTERNAL_WORKER_INDEX 0xFFFFFFFFu
+
+// Lets the core know that the thread is spinning, so that it saves power and leaves room to its other hyperthread.
+inline void pauseProcessor()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// How long a worker waited for tasks.
+struct IdleStatistics
+{
+	// Time spent spinning before a task showed up or the worker parked, and time spent parked.
+	std::chrono::nanoseconds spinningTime{ 0 };
+	std::chrono::nanoseconds parkedTime{ 0 };
+
+	// How many times the worker ran out of tasks, and how many of those times it had to park.
+	std::uint64_t numberOfSpins = 0;
+	std::uint64_t numberOfParks = 0;
+};
+
+// Interface shared by the different ways the TaskExecutor can distribute tasks among its workers.
+// The entries hold the index of the TaskManager they belong to in their upper 32 bits.
+// A worker that runs out of tasks spins for a while before parking, since the next task often comes right away.
+class TaskQueue
 {
 public:
+	// spinIterations is how many times a worker checks for tasks, pausing in between, before it parks.
+	TaskQueue(unsigned int numberOfWorkers, unsigned int spinIterations);
+	virtual ~TaskQueue() = default;
+
 	// Pushes a task index to the queue in a threadsafe way.
-	void push(unsigned int taskIndex);
+	// workerIndex is the pool thread doing the push, or EXTERNAL_WORKER_INDEX.
+	// Queues that support it hand out the tasks with higher priorities first.
+	virtual void push(unsigned int workerIndex, std::uint64_t taskIndex, float priority) = 0;
+
+	// Pushes several task indices at once, and wakes up as many parked workers as needed to run them.
+	virtual void push(unsigned int workerIndex, const std::uint64_t* taskIndices, const float* priorities, unsigned int numberOfTasks) = 0;
+
+	// Pops a task index for the given worker, or waits until one is available.
+	// Returns false without a task as soon as stop is set, which must be followed by wakeAll().
+	virtual bool pop(unsigned int workerIndex, std::uint64_t& taskIndex, const std::atomic<bool>& stop) = 0;
+
+	// Wakes up every waiting worker, so that they check their stop flag again.
+	virtual void wakeAll() = 0;
+
+	// Can be called while the workers run, the numbers can be slightly behind.
+	IdleStatistics getIdleStatistics(unsigned int workerIndex) const;
+
+protected:
+	// Checks for a task until stop is set, hasTask() returns true or the spin budget runs out.
+	// Returns false if the worker has to park.
+	template<class HasTask>
+	bool spin(unsigned int workerIndex, const std::atomic<bool>& stop, HasTask&& hasTask);
+
+	// Adds the time a worker was parked for.
+	void addParkedTime(unsigned int workerIndex, std::chrono::steady_clock::time_point parkTime);
+
+private:
+	// Only written by the worker itself, so they are updated with plain loads and stores.
+	struct alignas(64) IdleCounters
+	{
+		std::atomic<std::uint64_t> spinningTime{ 0 };
+		std::atomic<std::uint64_t> parkedTime{ 0 };
+		std::atomic<std::uint64_t> numberOfSpins{ 0 };
+		std::atomic<std::uint64_t> numberOfParks{ 0 };
+	};
+
+	static void add(std::atomic<std::uint64_t>& counter, std::uint64_t value) { counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed); }
+
+	const unsigned int numberOfWorkers;
+	const unsigned int spinIterations;
+	std::unique_ptr<IdleCounters[]> idleCounters;
+};
 
-	// Pops a task index from the queue in a threadsafe way, or waits until
-	// one is available if the queue is empty.
-	unsigned int pop();
+template<class HasTask>
+bool TaskQueue::spin(unsigned int workerIndex, const std::atomic<bool>& stop, HasTask&& hasTask)
+{
+	if (stop.load(std::memory_order_relaxed) || hasTask()) return true;
+
+	const auto start = std::chrono::steady_clock::now();
+	bool found = false;
+	for (unsigned int i = 0; i < spinIterations && !found; i++)
+	{
+		pauseProcessor();
+		found = stop.load(std::memory_order_relaxed) || hasTask();
+	}
+
+	if (workerIndex < numberOfWorkers)
+	{
+		IdleCounters& counters = idleCounters[workerIndex];
+		add(counters.spinningTime, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		add(counters.numberOfSpins, 1);
+		if (!found) add(counters.numberOfParks, 1);
+	}
+	return found;
+}
+
+// Base of the queues shared by every worker and guarded by a mutex. Parked workers get woken up one by one,
+// only as many as there are new tasks, and workers that are still spinning pick up the rest.
+class LockedTaskQueue : public TaskQueue
+{
+public:
+	LockedTaskQueue(unsigned int numberOfWorkers, unsigned int spinIterations);
+
+	void push(unsigned int workerIndex, std::uint64_t taskIndex, float priority) override;
+	void push(unsigned int workerIndex, const std::uint64_t* taskIndices, const float* priorities, unsigned int numberOfTasks) override;
+	bool pop(unsigned int workerIndex, std::uint64_t& taskIndex, const std::atomic<bool>& stop) override;
+	void wakeAll() override;
+
+protected:
+	// Store and take the tasks, always called with the lock held.
+	virtual void addTask(std::uint64_t taskIndex, float priority) = 0;
+	virtual std::uint64_t takeTask() = 0;
 
 private:
-	std::vector<unsigned int> queuedTasks;
+	// Returns how many parked workers have to be notified for a number of new tasks, and counts them as pending.
+	// Must be called with the lock held.
+	unsigned int reserveWakeups(unsigned int numberOfTasks);
+
+	// Readable without the lock so that spinning workers don't need it.
+	std::atomic<unsigned int> numberOfQueuedTasks{ 0 };
+
+	// Parked workers, and how many of them were already notified but didn't wake up yet.
+	unsigned int numberOfParkedWorkers = 0;
+	unsigned int numberOfPendingWakeups = 0;
 
 	std::condition_variable cv;
 	std::mutex lock;
 };
+
+// A single queue shared by every worker.
+class Mailbox : public LockedTaskQueue
+{
+public:
+	using LockedTaskQueue::LockedTaskQueue;
+
+protected:
+	void addTask(std::uint64_t taskIndex, float priority) override;
+	std::uint64_t takeTask() override;
+
+private:
+	std::vector<std::uint64_t> queuedTasks;
+};
+
+// A single queue shared by every worker, that hands out the task with the highest priority first.
+class PriorityMailbox : public LockedTaskQueue
+{
+public:
+	using LockedTaskQueue::LockedTaskQueue;
+
+protected:
+	void addTask(std::uint64_t taskIndex, float priority) override;
+	std::uint64_t takeTask() override;
+
+private:
+	struct QueuedTask
+	{
+		float priority;
+		std::uint64_t taskIndex;
+
+		bool operator<(const QueuedTask& other) const { return priority < other.priority; }
+	};
+
+	std::vector<QueuedTask> queuedTasks;
+};
+
+// A queue shared by every worker that takes turns among the TaskManagers with ready tasks,
+// so that one with lots of tasks can't keep the others waiting.
+class FairMailbox : public LockedTaskQueue
+{
+public:
+	FairMailbox(unsigned int numberOfOwners, unsigned int numberOfWorkers, unsigned int spinIterations);
+
+protected:
+	// Stores the task with the others of its TaskManager.
+	void addTask(std::uint64_t taskIndex, float priority) override;
+
+	// Takes a task from the next TaskManager that has any.
+	std::uint64_t takeTask() override;
+
+private:
+	std::vector<std::vector<std::uint64_t>> queuedTasks;
+	unsigned int lastOwner = 0;
+};
+
+// Chase-Lev deque. The owner pushes and pops at the bottom without locking,
+// while any other thread can steal from the top.
+class WorkStealingDeque
+{
+public:
+	WorkStealingDeque();
+
+	// Only the owner may call these two.
+	void push(std::uint64_t taskIndex);
+	bool pop(std::uint64_t& taskIndex);
+
+	// Can be called by any thread. Fails if the deque is empty.
+	bool steal(std::uint64_t& taskIndex);
+
+private:
+	struct Buffer
+	{
+		explicit Buffer(std::int64_t capacity);
+
+		std::uint64_t get(std::int64_t index) const { return slots[index & (capacity - 1)].load(std::memory_order_relaxed); }
+		void put(std::int64_t index, std::uint64_t taskIndex) { slots[index & (capacity - 1)].store(taskIndex, std::memory_order_relaxed); }
+
+		const std::int64_t capacity;
+		std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+	};
+
+	// Doubles the size of the buffer, the old one is kept alive because thieves might still be reading it.
+	Buffer* grow(Buffer* oldBuffer, std::int64_t bottomIndex, std::int64_t topIndex);
+
+	alignas(64) std::atomic<std::int64_t> top;
+	alignas(64) std::atomic<std::int64_t> bottom;
+	std::atomic<Buffer*> buffer;
+	std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+// Every worker owns a deque where it pushes the tasks it unlocks, and steals from the
+// other workers when its own deque runs dry.
+class WorkStealingQueue : public TaskQueue
+{
+public:
+	WorkStealingQueue(unsigned int numberOfWorkers, unsigned int spinIterations);
+
+	// Pushes to the worker's own deque, or to the shared injection queue for external threads.
+	// Priorities are ignored, every worker takes its newest task first.
+	void push(unsigned int workerIndex, std::uint64_t taskIndex, float priority) override;
+	void push(unsigned int workerIndex, const std::uint64_t* taskIndices, const float* priorities, unsigned int numberOfTasks) override;
+
+	// Takes from the worker's own deque, then the injection queue, then the other workers.
+	// Keeps trying for a while if there's nothing to do anywhere, then sleeps.
+	bool pop(unsigned int workerIndex, std::uint64_t& taskIndex, const std::atomic<bool>& stop) override;
+
+	void wakeAll() override;
+
+private:
+	bool tryPop(unsigned int workerIndex, std::uint64_t& taskIndex);
+
+	// Wakes up as many sleeping workers as there are new tasks, if there's any.
+	void wakeWorkers(unsigned int numberOfTasks);
+
+	std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+
+	// Tasks pushed by threads that don't own a deque.
+	std::mutex injectionLock;
+	std::vector<std::uint64_t> injectedTasks;
+	std::atomic<unsigned int> numberOfInjectedTasks{ 0 };
+
+	// Used to put workers to sleep when there's nothing to steal.
+	std::mutex idleLock;
+	std::condition_variable idleCv;
+	std::atomic<unsigned int> sleepingWorkers{ 0 };
+	std::atomic<std::uint64_t> wakeEpoch{ 0 };
+};
@@ -0,0 +1,89 @@
+#include "TaskTracer.h"
+
+#if TASK_MANAGER_TRACING
+
+#include <algorithm>
+
+// Escapes a string to be written inside JSON quotes.
+static std::string escapeJson(const std::string& text)
+{
+	std::string result;
+	for (char character : text)
+	{
+		if (character == '"' || character == '\\') result += '\\';
+		if (static_cast<unsigned char>(character) < 0x20) result += ' ';
+		else result += character;
+	}
+	return result;
+}
+
+TaskTracer::TaskTracer(unsigned int numberOfWorkers) :
+	creationTime(std::chrono::steady_clock::now())
+{
+	for (unsigned int i = 0; i < numberOfWorkers; i++) ringBuffers.emplace_back(new RingBuffer());
+}
+
+void TaskTracer::setEnabled(bool enabled)
+{
+	this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void TaskTracer::setNumberOfTasks(unsigned int numberOfTasks, unsigned int numberOfSlots)
+{
+	this->numberOfTasks = numberOfTasks;
+	readyTimes.assign(numberOfTasks * numberOfSlots, 0);
+	for (auto& ringBuffer : ringBuffers) ringBuffer->head.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t TaskTracer::now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - creationTime).count();
+}
+
+void TaskTracer::recordTask(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot, std::uint64_t tick, std::uint64_t startTime, std::uint64_t endTime)
+{
+	RingBuffer& ringBuffer = *ringBuffers[workerIndex];
+	const std::uint64_t head = ringBuffer.head.load(std::memory_order_relaxed);
+
+	// A task that was pushed before tracing got enabled has no ready time.
+	const std::uint64_t markedReadyTime = readyTimes[slot * numberOfTasks + taskIndex];
+	const std::uint64_t readyTime = markedReadyTime != 0 && markedReadyTime <= startTime ? markedReadyTime : startTime;
+	ringBuffer.records[head % TASK_TRACE_BUFFER_SIZE] = { readyTime, startTime, endTime, tick, taskIndex };
+	ringBuffer.head.store(head + 1, std::memory_order_release);
+}
+
+void TaskTracer::writeChromeTrace(std::ostream& output, const TaskNameGetter& taskName) const
+{
+	output << "{\"traceEvents\":[";
+
+	bool firstEvent = true;
+	for (unsigned int workerIndex = 0; workerIndex < ringBuffers.size(); workerIndex++)
+	{
+		const RingBuffer& ringBuffer = *ringBuffers[workerIndex];
+		const std::uint64_t head = ringBuffer.head.load(std::memory_order_acquire);
+		const std::uint64_t tail = head > TASK_TRACE_BUFFER_SIZE ? head - TASK_TRACE_BUFFER_SIZE : 0;
+		std::vector<Record> records;
+		for (std::uint64_t i = tail; i < head; i++) records.push_back(ringBuffer.records[i % TASK_TRACE_BUFFER_SIZE]);
+
+		// Dropping the records the thread might have been overwriting while they were being copied.
+		const std::uint64_t newHead = ringBuffer.head.load(std::memory_order_acquire);
+		const std::uint64_t firstSafeRecord = newHead >= TASK_TRACE_BUFFER_SIZE ? newHead - TASK_TRACE_BUFFER_SIZE + 1 : 0;
+		const std::size_t overwritten = firstSafeRecord > tail ? static_cast<std::size_t>(std::min<std::uint64_t>(firstSafeRecord - tail, records.size())) : 0;
+
+		for (auto record = records.begin() + overwritten; record != records.end(); record++)
+		{
+			if (!firstEvent) output << ",";
+			firstEvent = false;
+
+			output << "\n{\"name\":\"" << escapeJson(taskName(record->taskIndex)) << "\",\"cat\":\"task\",\"ph\":\"X\""
+				<< ",\"ts\":" << record->startTime / 1000.0
+				<< ",\"dur\":" << (record->endTime - record->startTime) / 1000.0
+				<< ",\"pid\":0,\"tid\":" << workerIndex
+				<< ",\"args\":{\"tick\":" << record->tick << ",\"queue_wait_us\":" << (record->startTime - record->readyTime) / 1000.0 << "}}";
+		}
+	}
+
+	output << "\n]}" << std::endl;
+}
+
+#endif
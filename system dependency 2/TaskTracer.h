@@ -0,0 +1,91 @@
+#pragma once
+
+// Set to 1 to build the task timeline capture into the TaskManager.
+// With 0 every method of the TaskTracer is empty, and the calls compile down to nothing.
+#ifndef TASK_MANAGER_TRACING
+#define TASK_MANAGER_TRACING 0
+#endif
+
+// The number of task executions every thread remembers, older ones get overwritten.
+#define TASK_TRACE_BUFFER_SIZE 65536
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Records when every task ran, on which thread, and how long it waited in the queue.
+class TaskTracer
+{
+public:
+	// Gives the name to show for a task index.
+	using TaskNameGetter = std::function<std::string(unsigned int)>;
+
+#if TASK_MANAGER_TRACING
+	explicit TaskTracer(unsigned int numberOfWorkers);
+
+	// Tracing starts disabled, so that it can be built in and only turned on when needed.
+	void setEnabled(bool enabled);
+	bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	// Makes room for the ready timestamps of every task in every tick slot. Drops the recorded executions,
+	// whose task indices belong to the previous graph. Must be called while no task is running.
+	void setNumberOfTasks(unsigned int numberOfTasks, unsigned int numberOfSlots);
+
+	// Nanoseconds since the tracer was created.
+	std::uint64_t now() const;
+
+	// Called when a task is pushed to the queue, so that its waiting time can be known.
+	void markReady(unsigned int taskIndex, unsigned int slot)
+	{
+		if (isEnabled()) readyTimes[slot * numberOfTasks + taskIndex] = now();
+	}
+
+	// Stores an execution of a task in the ring buffer of the thread that ran it.
+	// Only that thread may call this with its own workerIndex.
+	void recordTask(unsigned int workerIndex, unsigned int taskIndex, unsigned int slot, std::uint64_t tick, std::uint64_t startTime, std::uint64_t endTime);
+
+	// Writes every recorded execution in Chrome's trace_event format, which can be opened in chrome://tracing.
+	// Should be called between ticks, executions recorded while writing might be left out.
+	void writeChromeTrace(std::ostream& output, const TaskNameGetter& taskName) const;
+
+private:
+	struct Record
+	{
+		std::uint64_t readyTime;
+		std::uint64_t startTime;
+		std::uint64_t endTime;
+		std::uint64_t tick;
+		unsigned int taskIndex;
+	};
+
+	// Written only by its thread, so it only needs the atomic head to be read from other threads.
+	struct alignas(64) RingBuffer
+	{
+		std::unique_ptr<Record[]> records{ new Record[TASK_TRACE_BUFFER_SIZE] };
+		std::atomic<std::uint64_t> head{ 0 };
+	};
+
+	std::vector<std::unique_ptr<RingBuffer>> ringBuffers;
+	std::vector<std::uint64_t> readyTimes;
+	unsigned int numberOfTasks = 0;
+	std::atomic<bool> enabled{ false };
+	const std::chrono::steady_clock::time_point creationTime;
+#else
+	explicit TaskTracer(unsigned int) {}
+
+	void setEnabled(bool) {}
+	bool isEnabled() const { return false; }
+	void setNumberOfTasks(unsigned int, unsigned int) {}
+	std::uint64_t now() const { return 0; }
+	void markReady(unsigned int, unsigned int) {}
+	void recordTask(unsigned int, unsigned int, unsigned int, std::uint64_t, std::uint64_t, std::uint64_t) {}
+
+	// Writes an empty trace.
+	void writeChromeTrace(std::ostream& output, const TaskNameGetter&) const { output << "{\"traceEvents\":[]}" << std::endl; }
+#endif
+};
@@ -0,0 +1,38 @@
+// What the benchmarks have in common. Every benchmark is a single file, built from the parent folder with something like:
+// g++ -std=c++17 -O2 -pthread benchmarks/SchedulingModeBenchmark.cpp FrameArena.cpp TaskDependencyGraph.cpp TaskExecutor.cpp TaskManager.cpp TaskQueue.cpp TaskTracer.cpp
+
+#pragma once
+
+#include "../TaskManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Where the busy work leaves its result, so that the compiler can't leave the work out.
+inline std::atomic<unsigned int> sink{ 0 };
+
+// Work that takes about the same time for the same number of iterations, standing for what a task does.
+inline void busyWork(unsigned int iterations)
+{
+	unsigned int value = 0;
+	for (unsigned int i = 0; i < iterations; i++) value = value * 1664525u + 1013904223u;
+	sink.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline std::string taskName(unsigned int task)
+{
+	return "task" + std::to_string(task);
+}
+
+// Runs some ticks to start the threads and warm up the caches, and returns the average time of the ticks after them in microseconds.
+inline double timeTicks(TaskManager& taskManager, unsigned int numberOfWarmUpTicks, unsigned int numberOfTicks)
+{
+	for (unsigned int i = 0; i < numberOfWarmUpTicks; i++) taskManager.run();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < numberOfTicks; i++) taskManager.run();
+	const auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::micro>(end - start).count() / numberOfTicks;
+}
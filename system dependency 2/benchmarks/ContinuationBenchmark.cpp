@@ -0,0 +1,96 @@
+// Compares ticks with and without continuation inlining, on graphs made of parallel chains of tasks
+// and on graphs where every task unlocks lots of others at once.
+
+#include "BenchmarkUtils.h"
+
+#include <iostream>
+#include <string>
+
+// The chain-heavy graph has this many independent chains, each this long.
+#define NUMBER_OF_CHAINS 8
+#define CHAIN_LENGTH 100
+
+// The fan-out-heavy graph has this many layers, where a single task unlocks this many tasks that the next layer waits for.
+#define NUMBER_OF_LAYERS 10
+#define FAN_OUT 80
+
+// The number of iterations of busy work in every task, small enough that the scheduling shows.
+#define WORK_PER_TASK 200
+
+// The number of ticks that are timed for every case.
+#define NUMBER_OF_TICKS 1000
+
+void addTask(TaskManager& taskManager, unsigned int task, const std::vector<unsigned int>& precedingTasks)
+{
+	TaskInformation taskInformation;
+	taskInformation.name = taskName(task);
+	taskInformation.task = []() { busyWork(WORK_PER_TASK); };
+	for (unsigned int precedingTask : precedingTasks) taskInformation.precedingTasks.push_back(taskName(precedingTask));
+	taskManager.addTask(taskInformation);
+}
+
+void addChains(TaskManager& taskManager)
+{
+	for (unsigned int chain = 0; chain < NUMBER_OF_CHAINS; chain++)
+	{
+		for (unsigned int link = 0; link < CHAIN_LENGTH; link++)
+		{
+			const unsigned int task = chain * CHAIN_LENGTH + link;
+			if (link == 0) addTask(taskManager, task, {});
+			else addTask(taskManager, task, { task - 1 });
+		}
+	}
+}
+
+void addFanOuts(TaskManager& taskManager)
+{
+	// Every layer starts with a task that waits for the whole previous layer, and the rest of the layer waits for it.
+	unsigned int task = 0;
+	std::vector<unsigned int> previousLayer;
+	for (unsigned int layer = 0; layer < NUMBER_OF_LAYERS; layer++)
+	{
+		const unsigned int root = task++;
+		addTask(taskManager, root, previousLayer);
+
+		previousLayer.clear();
+		for (unsigned int i = 0; i < FAN_OUT; i++)
+		{
+			addTask(taskManager, task, { root });
+			previousLayer.push_back(task++);
+		}
+	}
+}
+
+// Returns the average time of a tick in microseconds.
+double benchmark(SchedulingMode schedulingMode, bool inlineContinuations, void (*addTasks)(TaskManager&))
+{
+	TaskManagerSettings settings;
+	settings.schedulingMode = schedulingMode;
+	settings.inlineContinuations = inlineContinuations;
+	TaskManager taskManager(settings);
+	addTasks(taskManager);
+	taskManager.generateDependencyGraph();
+	return timeTicks(taskManager, 50, NUMBER_OF_TICKS);
+}
+
+void benchmark(const std::string& modeName, SchedulingMode schedulingMode)
+{
+	const double queuedChains = benchmark(schedulingMode, false, addChains);
+	const double inlinedChains = benchmark(schedulingMode, true, addChains);
+	const double queuedFanOuts = benchmark(schedulingMode, false, addFanOuts);
+	const double inlinedFanOuts = benchmark(schedulingMode, true, addFanOuts);
+
+	std::cout << modeName << ": chains " << queuedChains << " us queued, " << inlinedChains << " us inlined ("
+		<< queuedChains / inlinedChains << "x), fan-outs " << queuedFanOuts << " us queued, " << inlinedFanOuts
+		<< " us inlined (" << queuedFanOuts / inlinedFanOuts << "x) per tick" << std::endl;
+}
+
+int main()
+{
+	std::cout << "Threads: " << NUMBER_OF_THREADS << ", " << NUMBER_OF_CHAINS << " chains of " << CHAIN_LENGTH << " tasks, "
+		<< NUMBER_OF_LAYERS << " layers of " << FAN_OUT << " tasks" << std::endl;
+	benchmark("Mailbox", SchedulingMode::Mailbox);
+	benchmark("WorkStealing", SchedulingMode::WorkStealing);
+	benchmark("CriticalPath", SchedulingMode::CriticalPath);
+	return 0;
+}
@@ -0,0 +1,70 @@
+// Compares the makespan of a tick with the critical path priorities against the usual ordering,
+// on random graphs where the tasks take very different amounts of time.
+
+#include "BenchmarkUtils.h"
+
+#include <iostream>
+#include <random>
+
+// The number of tasks in every generated graph.
+#define NUMBER_OF_TASKS 300
+
+// Every task depends on up to this many of the tasks added before it.
+#define MAX_PRECEDING_TASKS 3
+
+// The most expensive task costs this many times the cheapest one.
+#define MAX_COST 20
+
+// The number of iterations of busy work per unit of cost.
+#define WORK_PER_COST 500
+
+// The number of random graphs, and the number of ticks timed on each of them for every mode.
+#define NUMBER_OF_GRAPHS 5
+#define NUMBER_OF_TICKS 500
+
+double benchmark(SchedulingMode schedulingMode, unsigned int seed)
+{
+	TaskManagerSettings settings;
+	settings.schedulingMode = schedulingMode;
+	TaskManager taskManager(settings);
+
+	// The same seed gives the same graph for every mode. Tasks mostly depend on recent ones,
+	// so there are long chains mixed with lots of short independent work.
+	std::mt19937 random(seed);
+	for (unsigned int task = 0; task < NUMBER_OF_TASKS; task++)
+	{
+		const unsigned int cost = std::uniform_int_distribution<unsigned int>(1, MAX_COST)(random);
+
+		TaskInformation taskInformation;
+		taskInformation.name = taskName(task);
+		taskInformation.task = [cost]() { busyWork(cost * WORK_PER_COST); };
+		taskInformation.cost = static_cast<float>(cost);
+		if (task > 0)
+		{
+			const unsigned int numberOfPrecedingTasks = std::uniform_int_distribution<unsigned int>(0, MAX_PRECEDING_TASKS)(random);
+			for (unsigned int i = 0; i < numberOfPrecedingTasks; i++)
+			{
+				const unsigned int distance = std::geometric_distribution<unsigned int>(0.1)(random) % task + 1;
+				taskInformation.precedingTasks.push_back(taskName(task - distance));
+			}
+		}
+		taskManager.addTask(taskInformation);
+	}
+
+	taskManager.generateDependencyGraph();
+	return timeTicks(taskManager, 20, NUMBER_OF_TICKS);
+}
+
+int main()
+{
+	std::cout << "Threads: " << NUMBER_OF_THREADS << ", tasks per tick: " << NUMBER_OF_TASKS << std::endl;
+	for (unsigned int seed = 1; seed <= NUMBER_OF_GRAPHS; seed++)
+	{
+		const double mailbox = benchmark(SchedulingMode::Mailbox, seed);
+		const double workStealing = benchmark(SchedulingMode::WorkStealing, seed);
+		const double criticalPath = benchmark(SchedulingMode::CriticalPath, seed);
+		std::cout << "Graph " << seed << ": Mailbox " << mailbox << " us, WorkStealing " << workStealing
+			<< " us, CriticalPath " << criticalPath << " us per tick, " << mailbox / criticalPath << "x the speed of Mailbox" << std::endl;
+	}
+	return 0;
+}
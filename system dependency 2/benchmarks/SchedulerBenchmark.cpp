@@ -0,0 +1,403 @@
+// Runs synthetic task graphs through the TaskManager and through the GameState of the first prototype, and writes
+// the tick latency percentiles, the overhead per task and the scaling with the number of threads as CSV or JSON,
+// so that the results can be compared between versions.
+// Run with --help to see the options.
+
+#include "BenchmarkUtils.h"
+#include "../../system dependency/GameState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The iterations of busy work in every task, unless told otherwise.
+#define DEFAULT_WORK 100
+
+// Without a number of ticks, every case runs about this many tasks, within these bounds of ticks.
+#define TASKS_PER_CASE 1000000
+#define MIN_TICKS 5
+#define MAX_TICKS 1000
+
+// The ticks run before timing, to start the threads and warm up the caches.
+#define WARM_UP_TICKS 3
+
+// In the random layered graphs, every task depends on up to this many tasks of the previous layer.
+#define MAX_PRECEDING_TASKS 3
+#define RANDOM_SEED 1
+
+// The GameState graphs are made of types, so their size is fixed when building.
+// The layered one has layers of this many systems, and every system depends on two systems of the previous layer.
+#define GAMESTATE_SYSTEMS 16
+#define GAMESTATE_LAYER_WIDTH 4
+
+// The number of times the busy work is timed on its own, to know how long a task takes without any scheduling.
+#define CALIBRATION_RUNS 10000
+
+struct Options
+{
+	std::vector<std::string> shapes = { "fanout", "chain", "layered" };
+	std::vector<unsigned int> numbersOfTasks = { 10, 100, 1000, 10000, 100000 };
+	unsigned int work = DEFAULT_WORK;
+	unsigned int maxThreads = NUMBER_OF_THREADS;
+	unsigned int ticks = 0;
+	SchedulingMode schedulingMode = SchedulingMode::Mailbox;
+	bool json = false;
+	bool gameState = true;
+};
+
+// What one case measured. The durations are in microseconds.
+struct Result
+{
+	std::string scheduler;
+	std::string shape;
+	unsigned int numberOfTasks = 0;
+	unsigned int numberOfThreads = 0;
+	unsigned int numberOfTicks = 0;
+	double p50 = 0.0;
+	double p90 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+	double mean = 0.0;
+
+	// The thread time that didn't go into running the tasks' work, divided among the tasks, in nanoseconds.
+	double overheadPerTask = 0.0;
+
+	// How many times faster than with one thread.
+	double speedup = 1.0;
+
+	// How long it took to generate the dependency graph, in milliseconds.
+	// The GameState works out its schedule when compiling, so it has nothing to build.
+	double buildTime = 0.0;
+};
+
+std::vector<std::string> split(const std::string& text)
+{
+	std::vector<std::string> parts;
+	std::stringstream stream(text);
+	std::string part;
+	while (std::getline(stream, part, ',')) if (!part.empty()) parts.push_back(part);
+	return parts;
+}
+
+// Returns false if the arguments can't be understood.
+bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		const std::size_t equals = argument.find('=');
+		const std::string name = argument.substr(0, equals);
+		const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+		try
+		{
+			if (name == "--shapes") options.shapes = split(value);
+			else if (name == "--tasks")
+			{
+				options.numbersOfTasks.clear();
+				for (const auto& numberOfTasks : split(value)) options.numbersOfTasks.push_back(std::stoul(numberOfTasks));
+			}
+			else if (name == "--work") options.work = std::stoul(value);
+			else if (name == "--threads") options.maxThreads = std::max<unsigned int>(std::stoul(value), 1);
+			else if (name == "--ticks") options.ticks = std::stoul(value);
+			else if (name == "--format" && (value == "csv" || value == "json")) options.json = value == "json";
+			else if (name == "--gamestate" && (value == "0" || value == "1")) options.gameState = value == "1";
+			else if (name == "--mode" && value == "mailbox") options.schedulingMode = SchedulingMode::Mailbox;
+			else if (name == "--mode" && value == "workstealing") options.schedulingMode = SchedulingMode::WorkStealing;
+			else if (name == "--mode" && value == "criticalpath") options.schedulingMode = SchedulingMode::CriticalPath;
+			else return false;
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	for (const auto& shape : options.shapes)
+	{
+		if (shape != "fanout" && shape != "chain" && shape != "layered") return false;
+	}
+	return true;
+}
+
+void printUsage()
+{
+	std::cerr << "Options, all optional:\n"
+		"  --shapes=fanout,chain,layered  the graphs to run\n"
+		"  --tasks=10,100,1000            the sizes of the TaskManager graphs\n"
+		"  --work=" << DEFAULT_WORK << "                     iterations of busy work in every task\n"
+		"  --threads=N                    runs both schedulers with 1, 2, 4... up to N threads\n"
+		"  --ticks=N                      timed ticks for every case, automatic by default\n"
+		"  --mode=mailbox|workstealing|criticalpath\n"
+		"  --format=csv|json\n"
+		"  --gamestate=0|1                also runs the GameState graphs of " << GAMESTATE_SYSTEMS << " systems" << std::endl;
+}
+
+unsigned int numberOfTicks(const Options& options, unsigned int numberOfTasks)
+{
+	if (options.ticks > 0) return options.ticks;
+	return std::min(std::max(TASKS_PER_CASE / std::max(numberOfTasks, 1u), static_cast<unsigned int>(MIN_TICKS)), static_cast<unsigned int>(MAX_TICKS));
+}
+
+// How long the work of one task takes when it runs on its own, in nanoseconds.
+double calibrateWork(unsigned int work)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < CALIBRATION_RUNS; i++) busyWork(work);
+	const auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / CALIBRATION_RUNS;
+}
+
+// Fills in the statistics of a result from the duration of every tick.
+void summarize(std::vector<std::chrono::nanoseconds> tickDurations, double workPerTask, Result& result)
+{
+	std::sort(tickDurations.begin(), tickDurations.end());
+	const auto percentile = [&](double fraction)
+	{
+		const std::size_t rank = static_cast<std::size_t>(std::ceil(fraction * tickDurations.size()));
+		return std::chrono::duration<double, std::micro>(tickDurations[std::max<std::size_t>(rank, 1) - 1]).count();
+	};
+
+	std::chrono::nanoseconds total{ 0 };
+	for (auto duration : tickDurations) total += duration;
+
+	result.numberOfTicks = static_cast<unsigned int>(tickDurations.size());
+	result.p50 = percentile(0.5);
+	result.p90 = percentile(0.9);
+	result.p99 = percentile(0.99);
+	result.max = percentile(1.0);
+	result.mean = std::chrono::duration<double, std::micro>(total).count() / tickDurations.size();
+	result.overheadPerTask = (result.mean * 1000.0 * result.numberOfThreads - workPerTask * result.numberOfTasks) / result.numberOfTasks;
+}
+
+// The preceding tasks of every task of a synthetic graph.
+std::vector<std::vector<unsigned int>> generateGraph(const std::string& shape, unsigned int numberOfTasks)
+{
+	std::vector<std::vector<unsigned int>> precedingTasks(numberOfTasks);
+	if (shape == "fanout")
+	{
+		// A single task unlocks all the others at once.
+		for (unsigned int task = 1; task < numberOfTasks; task++) precedingTasks[task].push_back(0);
+	}
+	else if (shape == "chain")
+	{
+		for (unsigned int task = 1; task < numberOfTasks; task++) precedingTasks[task].push_back(task - 1);
+	}
+	else
+	{
+		// About as many layers as tasks in every layer, every task waiting for some random tasks of the previous layer.
+		std::mt19937 random(RANDOM_SEED);
+		const unsigned int layerWidth = std::max(static_cast<unsigned int>(std::sqrt(numberOfTasks)), 1u);
+		for (unsigned int task = layerWidth; task < numberOfTasks; task++)
+		{
+			const unsigned int previousLayer = (task / layerWidth - 1) * layerWidth;
+			const unsigned int numberOfPrecedingTasks = std::uniform_int_distribution<unsigned int>(1, MAX_PRECEDING_TASKS)(random);
+			for (unsigned int i = 0; i < numberOfPrecedingTasks; i++)
+			{
+				const unsigned int precedingTask = previousLayer + std::uniform_int_distribution<unsigned int>(0, layerWidth - 1)(random);
+				if (std::find(precedingTasks[task].begin(), precedingTasks[task].end(), precedingTask) == precedingTasks[task].end())
+					precedingTasks[task].push_back(precedingTask);
+			}
+		}
+	}
+	return precedingTasks;
+}
+
+// The tasks of a synthetic graph, generated once and then given to the TaskManager of every thread count.
+std::vector<TaskInformation> generateTasks(const std::string& shape, unsigned int numberOfTasks, unsigned int work)
+{
+	const auto precedingTasks = generateGraph(shape, numberOfTasks);
+	std::vector<TaskInformation> tasks(numberOfTasks);
+	for (unsigned int task = 0; task < numberOfTasks; task++)
+	{
+		tasks[task].name = taskName(task);
+		tasks[task].task = [work]() { busyWork(work); };
+		for (unsigned int precedingTask : precedingTasks[task]) tasks[task].precedingTasks.push_back(taskName(precedingTask));
+	}
+	return tasks;
+}
+
+// The TaskManager runs its ticks with the calling thread and a pool of one thread less, so one thread means no pool at all.
+Result benchmarkTaskManager(const Options& options, const std::string& shape, const std::vector<TaskInformation>& tasks, unsigned int numberOfThreads, double workPerTask)
+{
+	TaskManagerSettings settings;
+	settings.schedulingMode = options.schedulingMode;
+	settings.numberOfThreads = numberOfThreads;
+	TaskManager taskManager(settings);
+
+	// The dependency graph is laid out for the workers of the executor, so every TaskManager generates its own.
+	const unsigned int numberOfTasks = static_cast<unsigned int>(tasks.size());
+	for (const auto& task : tasks) taskManager.addTask(task);
+	const auto buildStart = std::chrono::steady_clock::now();
+	taskManager.generateDependencyGraph();
+	const auto buildEnd = std::chrono::steady_clock::now();
+
+	for (unsigned int i = 0; i < WARM_UP_TICKS; i++) taskManager.run();
+
+	std::vector<std::chrono::nanoseconds> tickDurations;
+	for (unsigned int i = numberOfTicks(options, numberOfTasks); i > 0; i--)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		taskManager.run();
+		tickDurations.push_back(std::chrono::steady_clock::now() - start);
+	}
+
+	Result result{ "TaskManager", shape, numberOfTasks, numberOfThreads };
+	summarize(tickDurations, workPerTask, result);
+	result.buildTime = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+	return result;
+}
+
+// The systems of the GameState graphs, which all run the same busy work.
+unsigned int gameStateWork = DEFAULT_WORK;
+
+class BusySystem
+{
+public:
+	void init() {}
+	void update(unsigned int) { busyWork(gameStateWork); }
+};
+
+template<std::size_t I>
+class FanOutSystem : public std::conditional_t<I == 0, System<>, System<FanOutSystem<0>>>, public BusySystem {};
+
+template<std::size_t I>
+class ChainSystem : public std::conditional_t<I == 0, System<>, System<ChainSystem<(I > 0 ? I - 1 : 0)>>>, public BusySystem {};
+
+// Two different systems of the previous layer, picked by hashing the index of the system.
+constexpr std::size_t layerHash(std::size_t i) { return (i * 2654435761u) >> 7; }
+constexpr std::size_t previousLayerStart(std::size_t i) { return i < GAMESTATE_LAYER_WIDTH ? 0 : (i / GAMESTATE_LAYER_WIDTH - 1) * GAMESTATE_LAYER_WIDTH; }
+constexpr std::size_t firstParent(std::size_t i) { return previousLayerStart(i) + layerHash(i) % GAMESTATE_LAYER_WIDTH; }
+constexpr std::size_t secondParent(std::size_t i)
+{
+	return previousLayerStart(i) + (layerHash(i) % GAMESTATE_LAYER_WIDTH + 1 + layerHash(i) / GAMESTATE_LAYER_WIDTH % (GAMESTATE_LAYER_WIDTH - 1)) % GAMESTATE_LAYER_WIDTH;
+}
+
+template<std::size_t I>
+class LayeredSystem : public std::conditional_t<I < GAMESTATE_LAYER_WIDTH, System<>, System<LayeredSystem<firstParent(I)>, LayeredSystem<secondParent(I)>>>, public BusySystem {};
+
+template<template<std::size_t> class SystemTemplate, class Indices>
+struct SyntheticGameState;
+
+template<template<std::size_t> class SystemTemplate, std::size_t... I>
+struct SyntheticGameState<SystemTemplate, std::index_sequence<I...>>
+{
+	using Type = GameState<SystemTemplate<I>...>;
+};
+
+// The GameState also runs its systems on the thread calling update(), so it gets one worker less than the number of threads.
+template<template<std::size_t> class SystemTemplate>
+Result benchmarkGameState(const Options& options, const std::string& shape, unsigned int numberOfThreads, double workPerTask)
+{
+	using SyntheticGameStateType = typename SyntheticGameState<SystemTemplate, std::make_index_sequence<GAMESTATE_SYSTEMS>>::Type;
+	gameStateWork = options.work;
+
+	// The GameState prints on every update, which would get timed too.
+	std::streambuf* output = std::cout.rdbuf(nullptr);
+	auto gameState = std::make_unique<SyntheticGameStateType>(numberOfThreads - 1);
+	gameState->init();
+
+	for (unsigned int i = 0; i < WARM_UP_TICKS; i++) gameState->update(1);
+
+	std::vector<std::chrono::nanoseconds> tickDurations;
+	for (unsigned int i = numberOfTicks(options, GAMESTATE_SYSTEMS); i > 0; i--)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		gameState->update(1);
+		tickDurations.push_back(std::chrono::steady_clock::now() - start);
+	}
+	std::cout.rdbuf(output);
+
+	Result result{ "GameState", shape, GAMESTATE_SYSTEMS, static_cast<unsigned int>(gameState->getNumberOfWorkers() + 1) };
+	summarize(tickDurations, workPerTask, result);
+	return result;
+}
+
+void writeCsv(const std::vector<Result>& results, unsigned int work)
+{
+	std::cout << "scheduler,shape,tasks,threads,work,ticks,p50_us,p90_us,p99_us,max_us,mean_us,overhead_per_task_ns,speedup,build_ms\n";
+	for (const auto& result : results)
+	{
+		std::cout << result.scheduler << ',' << result.shape << ',' << result.numberOfTasks << ',' << result.numberOfThreads << ','
+			<< work << ',' << result.numberOfTicks << ',' << result.p50 << ',' << result.p90 << ',' << result.p99 << ','
+			<< result.max << ',' << result.mean << ',' << result.overheadPerTask << ',' << result.speedup << ',' << result.buildTime << '\n';
+	}
+}
+
+void writeJson(const std::vector<Result>& results, unsigned int work)
+{
+	std::cout << "[\n";
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		const Result& result = results[i];
+		std::cout << "  { \"scheduler\": \"" << result.scheduler << "\", \"shape\": \"" << result.shape << "\", \"tasks\": " << result.numberOfTasks
+			<< ", \"threads\": " << result.numberOfThreads << ", \"work\": " << work << ", \"ticks\": " << result.numberOfTicks
+			<< ", \"p50_us\": " << result.p50 << ", \"p90_us\": " << result.p90 << ", \"p99_us\": " << result.p99 << ", \"max_us\": " << result.max
+			<< ", \"mean_us\": " << result.mean << ", \"overhead_per_task_ns\": " << result.overheadPerTask << ", \"speedup\": " << result.speedup
+			<< ", \"build_ms\": " << result.buildTime << " }" << (i + 1 < results.size() ? "," : "") << '\n';
+	}
+	std::cout << "]\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	const double workPerTask = calibrateWork(options.work);
+
+	// The thread counts double up to the highest one.
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int numberOfThreads = 1; numberOfThreads < options.maxThreads; numberOfThreads *= 2) threadCounts.push_back(numberOfThreads);
+	threadCounts.push_back(options.maxThreads);
+
+	// The progress goes to the error output, so that the results can be redirected to a file.
+	// The first thread count is always 1, which the speedups are measured against.
+	std::vector<Result> results;
+	for (const auto& shape : options.shapes)
+	{
+		for (unsigned int numberOfTasks : options.numbersOfTasks)
+		{
+			const auto tasks = generateTasks(shape, numberOfTasks, options.work);
+			double singleThreadMean = 0.0;
+			for (unsigned int numberOfThreads : threadCounts)
+			{
+				std::cerr << "TaskManager, " << shape << ", " << numberOfTasks << " tasks, " << numberOfThreads << " threads" << std::endl;
+				results.push_back(benchmarkTaskManager(options, shape, tasks, numberOfThreads, workPerTask));
+				if (numberOfThreads == 1) singleThreadMean = results.back().mean;
+				results.back().speedup = singleThreadMean / results.back().mean;
+			}
+		}
+
+		if (!options.gameState) continue;
+
+		double singleThreadMean = 0.0;
+		for (unsigned int numberOfThreads : threadCounts)
+		{
+			std::cerr << "GameState, " << shape << ", " << GAMESTATE_SYSTEMS << " systems, " << numberOfThreads << " threads" << std::endl;
+			if (shape == "fanout") results.push_back(benchmarkGameState<FanOutSystem>(options, shape, numberOfThreads, workPerTask));
+			else if (shape == "chain") results.push_back(benchmarkGameState<ChainSystem>(options, shape, numberOfThreads, workPerTask));
+			else results.push_back(benchmarkGameState<LayeredSystem>(options, shape, numberOfThreads, workPerTask));
+			if (numberOfThreads == 1) singleThreadMean = results.back().mean;
+			results.back().speedup = singleThreadMean / results.back().mean;
+		}
+	}
+
+	if (options.json) writeJson(results, options.work);
+	else writeCsv(results, options.work);
+	return 0;
+}
@@ -0,0 +1,52 @@
+// Compares the Mailbox and WorkStealing scheduling modes of the TaskManager
+// on a graph with lots of small systems.
+
+#include "BenchmarkUtils.h"
+
+#include <iostream>
+
+// The number of layers in the generated graph, every task depends on two tasks of the previous layer.
+#define NUMBER_OF_LAYERS 8
+
+// The number of tasks in every layer.
+#define TASKS_PER_LAYER 64
+
+// The number of iterations of busy work every task does.
+#define WORK_PER_TASK 200
+
+// The number of ticks that are timed for every mode.
+#define NUMBER_OF_TICKS 2000
+
+double benchmark(SchedulingMode schedulingMode)
+{
+	TaskManagerSettings settings;
+	settings.schedulingMode = schedulingMode;
+	TaskManager taskManager(settings);
+
+	for (unsigned int layer = 0; layer < NUMBER_OF_LAYERS; layer++)
+	{
+		for (unsigned int task = 0; task < TASKS_PER_LAYER; task++)
+		{
+			TaskInformation taskInformation;
+			taskInformation.name = taskName(layer * TASKS_PER_LAYER + task);
+			taskInformation.task = []() { busyWork(WORK_PER_TASK); };
+			if (layer > 0)
+			{
+				taskInformation.precedingTasks.push_back(taskName((layer - 1) * TASKS_PER_LAYER + task));
+				taskInformation.precedingTasks.push_back(taskName((layer - 1) * TASKS_PER_LAYER + (task + 1) % TASKS_PER_LAYER));
+			}
+			taskManager.addTask(taskInformation);
+		}
+	}
+
+	taskManager.generateDependencyGraph();
+	return timeTicks(taskManager, 100, NUMBER_OF_TICKS);
+}
+
+int main()
+{
+	std::cout << "Threads: " << NUMBER_OF_THREADS << ", tasks per tick: " << NUMBER_OF_LAYERS * TASKS_PER_LAYER << std::endl;
+	std::cout << "Mailbox: " << benchmark(SchedulingMode::Mailbox) << " us per tick" << std::endl;
+	std::cout << "WorkStealing: " << benchmark(SchedulingMode::WorkStealing) << " us per tick" << std::endl;
+	return 0;
+}
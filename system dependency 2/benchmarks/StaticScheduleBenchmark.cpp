@@ -0,0 +1,75 @@
+// Compares ticks scheduled as their tasks get unlocked against ticks replaying a static schedule compiled from
+// the measured durations, on random graphs of small tasks where the scheduling overhead shows.
+
+#include "BenchmarkUtils.h"
+
+#include <iostream>
+#include <random>
+
+// The number of tasks in every generated graph.
+#define NUMBER_OF_TASKS 500
+
+// Every task depends on up to this many of the tasks added before it.
+#define MAX_PRECEDING_TASKS 3
+
+// The most expensive task costs this many times the cheapest one.
+#define MAX_COST 10
+
+// The number of iterations of busy work per unit of cost, small enough that the scheduling shows.
+#define WORK_PER_COST 50
+
+// The number of ticks measured before compiling the schedule, and the number of ticks timed for every case.
+#define NUMBER_OF_MEASURED_TICKS 100
+#define NUMBER_OF_TICKS 1000
+
+// The number of random graphs.
+#define NUMBER_OF_GRAPHS 3
+
+void benchmark(unsigned int seed)
+{
+	TaskManagerSettings settings;
+	settings.schedulingMode = SchedulingMode::CriticalPath;
+	settings.measureTaskDurations = true;
+	TaskManager taskManager(settings);
+
+	// Tasks mostly depend on recent ones, so there are chains mixed with independent work.
+	std::mt19937 random(seed);
+	for (unsigned int task = 0; task < NUMBER_OF_TASKS; task++)
+	{
+		const unsigned int cost = std::uniform_int_distribution<unsigned int>(1, MAX_COST)(random);
+
+		TaskInformation taskInformation;
+		taskInformation.name = taskName(task);
+		taskInformation.task = [cost]() { busyWork(cost * WORK_PER_COST); };
+		taskInformation.cost = static_cast<float>(cost);
+		if (task > 0)
+		{
+			const unsigned int numberOfPrecedingTasks = std::uniform_int_distribution<unsigned int>(0, MAX_PRECEDING_TASKS)(random);
+			for (unsigned int i = 0; i < numberOfPrecedingTasks; i++)
+			{
+				const unsigned int distance = std::geometric_distribution<unsigned int>(0.1)(random) % task + 1;
+				taskInformation.precedingTasks.push_back(taskName(task - distance));
+			}
+		}
+		taskManager.addTask(taskInformation);
+	}
+
+	taskManager.generateDependencyGraph();
+
+	// The warm-up ticks measure the durations that the static schedule is compiled from.
+	const double dynamicTick = timeTicks(taskManager, NUMBER_OF_MEASURED_TICKS, NUMBER_OF_TICKS);
+
+	taskManager.compileStaticSchedule();
+	const double staticTick = timeTicks(taskManager, 0, NUMBER_OF_TICKS);
+	const bool stillStatic = taskManager.getLastTickStatistics().staticallyScheduled;
+
+	std::cout << "Graph " << seed << ": dynamic " << dynamicTick << " us, static " << staticTick << " us per tick ("
+		<< dynamicTick / staticTick << "x)" << (stillStatic ? "" : ", fell back to dynamic scheduling") << std::endl;
+}
+
+int main()
+{
+	std::cout << "Threads: " << NUMBER_OF_THREADS << ", tasks per tick: " << NUMBER_OF_TASKS << std::endl;
+	for (unsigned int seed = 1; seed <= NUMBER_OF_GRAPHS; seed++) benchmark(seed);
+	return 0;
+}
@@ -0,0 +1,56 @@
+// Measures how long the TaskManager takes to run a task that does nothing, in every scheduling mode,
+// both for independent tasks and for a chain where every task waits for the previous one.
+
+#include "BenchmarkUtils.h"
+
+#include <iostream>
+#include <string>
+
+// The number of empty tasks in every tick.
+#define NUMBER_OF_TASKS 1000
+
+// The number of ticks that are timed for every case.
+#define NUMBER_OF_TICKS 2000
+
+// Returns the average time of a tick in nanoseconds.
+double timeTicks(const TaskManagerSettings& settings, unsigned int numberOfTasks, bool chained)
+{
+	TaskManager taskManager(settings);
+	for (unsigned int task = 0; task < numberOfTasks; task++)
+	{
+		TaskInformation taskInformation;
+		taskInformation.name = taskName(task);
+		taskInformation.task = []() {};
+		if (chained && task > 0) taskInformation.precedingTasks.push_back(taskName(task - 1));
+		taskManager.addTask(taskInformation);
+	}
+
+	taskManager.generateDependencyGraph();
+	return timeTicks(taskManager, 100, NUMBER_OF_TICKS) * 1000.0;
+}
+
+void benchmark(const std::string& modeName, SchedulingMode schedulingMode, unsigned int numberOfThreads)
+{
+	TaskManagerSettings settings;
+	settings.schedulingMode = schedulingMode;
+	settings.numberOfThreads = numberOfThreads;
+
+	// The cost of the tick itself is taken out, so that only the tasks are left.
+	const double emptyTick = timeTicks(settings, 0, false);
+	const double independent = (timeTicks(settings, NUMBER_OF_TASKS, false) - emptyTick) / NUMBER_OF_TASKS;
+	const double chained = (timeTicks(settings, NUMBER_OF_TASKS, true) - emptyTick) / NUMBER_OF_TASKS;
+
+	std::cout << modeName << " with " << numberOfThreads << " threads: " << emptyTick << " ns per empty tick, "
+		<< independent << " ns per independent task, " << chained << " ns per chained task" << std::endl;
+}
+
+int main()
+{
+	for (unsigned int numberOfThreads : { 1u, NUMBER_OF_THREADS })
+	{
+		benchmark("Mailbox", SchedulingMode::Mailbox, numberOfThreads);
+		benchmark("WorkStealing", SchedulingMode::WorkStealing, numberOfThreads);
+		benchmark("CriticalPath", SchedulingMode::CriticalPath, numberOfThreads);
+	}
+	return 0;
+}
@@ -0,0 +1,88 @@
+// A counter that threads can wait on until it reaches zero, without mutexes where the platform can wait on the counter itself.
+
+#pragma once
+
+#include <atomic>
+#include <climits>
+
+#if defined(__cpp_lib_atomic_wait)
+// std::atomic can be waited on directly.
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+class CountdownLatch final {
+private:
+	// An unsigned int, so that it can be used as a futex.
+	std::atomic<unsigned int> count{ 0 };
+
+#if !defined(__cpp_lib_atomic_wait) && !defined(__linux__) && !defined(_WIN32)
+	// Anywhere else, the waiting threads sleep on a condition variable.
+	std::mutex sleepMutex;
+	std::condition_variable countChanged;
+#endif
+
+	// Sleeps until the count might have changed from the expected value.
+	void sleep(unsigned int expected) {
+#if defined(__cpp_lib_atomic_wait)
+		count.wait(expected, std::memory_order_acquire);
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<unsigned int*>(&count), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+		WaitOnAddress(&count, &expected, sizeof(expected), INFINITE);
+#else
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		countChanged.wait(lock, [this, expected]() { return count.load(std::memory_order_acquire) != expected; });
+#endif
+	}
+
+	void wakeAll() {
+#if defined(__cpp_lib_atomic_wait)
+		count.notify_all();
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<unsigned int*>(&count), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+		WakeByAddressAll(&count);
+#else
+		// Taking the mutex makes sure that a thread that saw the old count is already waiting.
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		countChanged.notify_all();
+#endif
+	}
+
+public:
+	static_assert(sizeof(std::atomic<unsigned int>) == sizeof(unsigned int) && std::atomic<unsigned int>::is_always_lock_free,
+		"The count can't be waited on directly!");
+
+	// Only while no thread is waiting or counting down.
+	void reset(unsigned int newCount) {
+		count.store(newCount, std::memory_order_relaxed);
+	}
+
+	// What the threads did before counting down is visible to the threads that return from wait().
+	void countDown() {
+		if (count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			wakeAll();
+	}
+
+	void wait() {
+		unsigned int current;
+		while ((current = count.load(std::memory_order_acquire)) != 0)
+			sleep(current);
+	}
+};
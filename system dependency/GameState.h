@@ -2,13 +2,17 @@
 
 #pragma once
 
+#include "CountdownLatch.h"
 #include "System.h"
+#include "SystemSchedule.h"
+#include "WorkerPool.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <iostream>
-#include <thread>
-#include <shared_mutex>
 #include <tuple>
-#include <vector>
+#include <utility>
 
 // Interface to the programmer.
 template<class... Systems>
@@ -16,173 +20,180 @@ class GameState final {
 private:
 	// A tuple which stores all the systems.
 	std::tuple<Systems...> systems;
-	using NumberOfSystems = std::tuple_size<decltype(systems)>;
 
-	// Auxiliary structure that holds information about each system.
-	struct SystemData {
-		// This mutex is used 
-		std::shared_timed_mutex systemMutex;
+	// The order in which the systems run, worked out when compiling.
+	using Schedule = SystemSchedule<Systems...>;
+	static_assert(Schedule::accessOrdered, "The systems that access the same components in conflicting ways must be ordered!");
 
-		// The numbers of the systems that have to run before this system.
-		std::vector<size_t> dependencies;
+	// How many direct dependencies of every system haven't updated yet in the current update cycle.
+	// The dependency that brings it to zero hands the system to the worker pool.
+	std::atomic<unsigned int> remainingDependencies[Schedule::numberOfSystems > 0 ? Schedule::numberOfSystems : 1];
 
-		// Flag that indicates whether the system was initialized or not.
-		bool was_initialized = false;
+	// The systems that haven't updated yet in the current update cycle.
+	CountdownLatch remainingSystems;
 
-		// Lambda interfaces to the system's methods.
-		std::function<void(void)> initializeSystem;
-		std::function<void(unsigned int)> updateSystem;
-	};
+	// The logic time of the current update cycle, stored here so that the jobs don't have to carry it.
+	unsigned int currentLogicTime = 0;
 
-	// An array with all the systems's data.
-	SystemData systemInformation[NumberOfSystems::value];
+	// How long every system took to initialize.
+	std::chrono::nanoseconds initializationTimes[Schedule::numberOfSystems > 0 ? Schedule::numberOfSystems : 1] = {};
 
-	// Locks all the mutexes before an update cycle.
-	void lockAllMutexes() {
-		for (size_t i = 0; i < NumberOfSystems::value; i++)
-			systemInformation[i].systemMutex.lock();
-	}
+	// The threads that run the systems. It's declared last so that it's destroyed first.
+	WorkerPool workerPool;
 
-	// Updates a system (if it wasn't previously initialized), and all of its dependencies if needed.
-	void initializeSystem(size_t systemNumber) {
-		SystemData& systemData = systemInformation[systemNumber];
+	// Initializes or updates a system, and releases the systems that depend on it.
+	// Returns one of the released systems for this thread to run next, or the number of systems if there's none.
+	template<bool Initializing, size_t SystemNumber>
+	size_t runSystem() {
+		if constexpr (Initializing) {
+			const auto start = std::chrono::steady_clock::now();
+			std::get<SystemNumber>(systems).init();
+			initializationTimes[SystemNumber] = std::chrono::steady_clock::now() - start;
+		}
+		else
+			std::get<SystemNumber>(systems).update(currentLogicTime);
 
-		// Checking that the system wasn't already initialized.
-		if(!systemData.was_initialized) {
-			// Initializing all the dependencies first.
-			for (const size_t systemDependency : systemData.dependencies)
-				initializeSystem(systemDependency);
+		size_t nextSystem = Schedule::numberOfSystems;
+		constexpr size_t dependentStart = Schedule::dependentStarts[SystemNumber];
+		releaseDependents<Initializing, dependentStart>(std::make_index_sequence<Schedule::dependentStarts[SystemNumber + 1] - dependentStart>(), nextSystem);
 
-			// Initializing the system itself.
-			systemData.initializeSystem();
+		remainingSystems.countDown();
+		return nextSystem;
+	}
 
-			// Setting the flag to avoid double initialization of the systems.
-			systemData.was_initialized = true;
-		}
+	template<bool Initializing, size_t... K>
+	static constexpr std::array<size_t (GameState::*)(), sizeof...(K)> generateSystemFunctions(std::index_sequence<K...>) {
+		return {{ &GameState::runSystem<Initializing, K>... }};
 	}
 
-	// Updates a system, and manages synchronization.
-	void updateSystem(size_t systemNumber, unsigned int logicTime) {
-		SystemData& systemData = systemInformation[systemNumber];
+	// Runs a system, and then the released systems it hands over, one after the other.
+	template<bool Initializing>
+	void runSystems(size_t systemNumber) {
+		static constexpr auto systemFunctions = generateSystemFunctions<Initializing>(std::make_index_sequence<Schedule::numberOfSystems>());
 
-		// Waiting for all of the dependencies to finish.
-		for (const size_t systemDependency : systemData.dependencies) {
-			systemInformation[systemDependency].systemMutex.lock_shared();
-		}
+		while (systemNumber < Schedule::numberOfSystems)
+			systemNumber = (this->*systemFunctions[systemNumber])();
+	}
 
-		// Updating the system.
-		systemData.updateSystem(logicTime);
+	// Hands a system to the worker pool.
+	template<bool Initializing>
+	void pushSystem(size_t systemNumber) {
+		workerPool.push([this, systemNumber]() {
+			runSystems<Initializing>(systemNumber);
+		});
+	}
 
-		// Unlocking the mutex so that other systems that depend on this system can update.
-		systemData.systemMutex.unlock();
+	template<bool Initializing, size_t DependentStart, size_t... K>
+	void releaseDependents(std::index_sequence<K...>, size_t& nextSystem) {
+		(releaseSystem<Initializing, Schedule::dependents[DependentStart + K]>(nextSystem), ...);
+	}
 
-		// Freeing the locks.
-		for (const size_t systemDependency : systemData.dependencies) {
-			systemInformation[systemDependency].systemMutex.unlock_shared();
+	// Counts down one dependency of a system. If it was the last one, the system is kept
+	// for this thread to run next, unless there already is one, and then it's pushed.
+	// The acquire and release make what all its dependencies did visible to it.
+	template<bool Initializing, size_t SystemNumber>
+	void releaseSystem(size_t& nextSystem) {
+		if (remainingDependencies[SystemNumber].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			if (nextSystem == Schedule::numberOfSystems)
+				nextSystem = SystemNumber;
+			else
+				pushSystem<Initializing>(SystemNumber);
 		}
 	}
 
-	// Auxiliary structs to translate system numbers to system types because
-	// using just decltype on tuples breaks the compiler lmao.
-
-	// Empty base struct.
-	template<size_t K, size_t SystemNumber, class... OtherSystems>
-	struct _numberToSystemTypeTranslator{};
-
-	// Struct with actually useful information.
-	template<size_t SystemNumber, class S, class... OtherSystems>
-	struct _numberToSystemTypeTranslator<SystemNumber, SystemNumber, S, OtherSystems...> {
-		using SystemType = S;
-	};
-
-	// Recursive template specialization.
-	template<size_t K, size_t SystemNumber, class S, class... OtherSystems>
-	struct _numberToSystemTypeTranslator<K, SystemNumber, S, OtherSystems...> : public _numberToSystemTypeTranslator<K + 1, SystemNumber, OtherSystems...> {};
-
-	// Pretty interface
-	template<size_t SystemNumber>
-	using numberToSystemTypeTranslator = _numberToSystemTypeTranslator<0, SystemNumber, Systems...>;
-
-	// Generates all the dependency data.
-	// Due to partial specialization of functions not being available
-	// (and my unwillingness to create a struct to hack around it)
-	// the system number and potential dependency are packed in a singular parameter.
-	template<size_t N>
-	void generateSystemDependencies() {
-		// Unpacking the parameters
-		constexpr size_t systemNumber = N % NumberOfSystems::value;
-		constexpr size_t potentialDependency = N / NumberOfSystems::value;
-
-		// If potentialDependency is actually a dependency.
-		if (depends_on<numberToSystemTypeTranslator<systemNumber>::SystemType, numberToSystemTypeTranslator<potentialDependency>::SystemType>::value)
-			// Add it to the dependency list.
-			systemInformation[systemNumber].dependencies.push_back(potentialDependency);
-
-		// Doing the next check.
-		generateSystemDependencies<N + 1>();
-	}
+	// Pushes all the systems that don't depend on anything but the last one, which this thread runs instead of waiting idly.
+	template<bool Initializing, size_t... K>
+	void startRoots(std::index_sequence<K...>) {
+		(pushSystem<Initializing>(Schedule::order[K]), ...);
 
-	// Empty function for the final recursive call.
-	template<>
-	void generateSystemDependencies<NumberOfSystems::value * NumberOfSystems::value>() {}
+		if constexpr (Schedule::numberOfRoots > 0)
+			runSystems<Initializing>(Schedule::order[Schedule::numberOfRoots - 1]);
+	}
 
-	// Generates the lambda interfaces that the system data has.
-	template<size_t SystemNumber>
-	void generateSystemFunctions() {
-		SystemData& systemData = systemInformation[SystemNumber];
-		auto& systemToCall = std::get<SystemNumber>(systems);
+	template<size_t... K>
+	void resetDependencies(std::index_sequence<K...>) {
+		(remainingDependencies[K].store(Schedule::dependencyCounts[K], std::memory_order_relaxed), ...);
+	}
 
-		// Getting the init method.
-		systemData.initializeSystem = [&systemToCall]() {
-			systemToCall.init();
-		};
+	// Initializes or updates all the systems, each one as soon as its dependencies finished, and waits for them.
+	template<bool Initializing>
+	void runAllSystems() {
+		// No system is running, and pushing them to the worker pool makes these visible to the workers.
+		resetDependencies(std::make_index_sequence<Schedule::numberOfSystems>());
+		remainingSystems.reset(Schedule::numberOfSystems);
 
-		// Getting the update method.
-		systemData.updateSystem = [&systemToCall](unsigned int logicTime) {
-			systemToCall.update(logicTime);
-		};
+		// The rest of the systems get pushed as their dependencies finish.
+		startRoots<Initializing>(std::make_index_sequence<Schedule::numberOfRoots - (Schedule::numberOfRoots > 0 ? 1 : 0)>());
 
-		// Generating the next system.
-		generateSystemFunctions<SystemNumber + 1>();
+		// Helping the workers while there are systems waiting for one.
+		while (workerPool.runPendingJob());
+		remainingSystems.wait();
 	}
 
-	// Empty function for the final recursive call.
-	template<>
-	void generateSystemFunctions<NumberOfSystems::value>() {}
+	// The longest time spent initializing a chain of dependent systems, which is as fast as the initialization can go.
+	std::chrono::nanoseconds getInitializationCriticalPath() const {
+		std::chrono::nanoseconds pathTimes[Schedule::numberOfSystems > 0 ? Schedule::numberOfSystems : 1] = {};
+		std::chrono::nanoseconds criticalPath{ 0 };
+
+		// In the order of the schedule, the dependencies of a system come before it.
+		for (size_t k = 0; k < Schedule::numberOfSystems; k++) {
+			const size_t i = Schedule::order[k];
+			for (size_t j = 0; j < Schedule::numberOfSystems; j++) {
+				if (Schedule::directDependencies[i * Schedule::numberOfSystems + j] && pathTimes[j] > pathTimes[i])
+					pathTimes[i] = pathTimes[j];
+			}
+
+			pathTimes[i] += initializationTimes[i];
+			if (pathTimes[i] > criticalPath)
+				criticalPath = pathTimes[i];
+		}
 
-public:
-	GameState() {
-		generateSystemDependencies<0>();
-		generateSystemFunctions<0>();
+		return criticalPath;
 	}
 
-	// Initializes all the systems in order.
+public:
+	// Runs the systems on one worker per hardware thread, besides the thread calling update().
+	GameState() = default;
+
+	// Runs the systems on a given number of workers besides the thread calling update(), which runs them all with none.
+	explicit GameState(size_t numberOfWorkers) : workerPool(numberOfWorkers) {}
+
+	// Initializes all the systems, the independent ones at the same time, and reports how long each one took.
 	void init() {
 		std::cout << "Initializing gamestate..." << std::endl;
 
-		for (size_t i = 0; i < NumberOfSystems::value; i++)
-			initializeSystem(i);
+		const auto start = std::chrono::steady_clock::now();
+		runAllSystems<true>();
+		const auto end = std::chrono::steady_clock::now();
+
+		std::chrono::nanoseconds totalTime{ 0 };
+		for (size_t i = 0; i < Schedule::numberOfSystems; i++) {
+			std::cout << "System " << i << " took " << std::chrono::duration<double, std::milli>(initializationTimes[i]).count() << " ms to initialize." << std::endl;
+			totalTime += initializationTimes[i];
+		}
 
-		std::cout << "Gamestate initialized!" << std::endl;
+		std::cout << "Gamestate initialized in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms ("
+			<< std::chrono::duration<double, std::milli>(totalTime).count() << " ms one after the other, "
+			<< std::chrono::duration<double, std::milli>(getInitializationCriticalPath()).count() << " ms on the critical path)!" << std::endl;
 	}
 
 	// Updates all the systems in order.
 	void update(unsigned int logicTime) {
 		std::cout << "Updating systems..." << std::endl;
 
-		// Locking all the threads to be later unlocked when the systems update.
-		lockAllMutexes();
+		currentLogicTime = logicTime;
+		runAllSystems<false>();
 
-		std::vector<std::thread> systemThreads;
-
-		// Spawning all the update threads. It should probably be done in a more efficient way.
-		for (size_t i = 0; i < NumberOfSystems::value; i++)
-			systemThreads.emplace(systemThreads.end(), &GameState::updateSystem, this, i, logicTime);
+		std::cout << std::endl << "Systems updated!" << std::endl;
+	}
 
-		// Waiting for all the systems to finish.
-		for (auto& systemThread : systemThreads)
-			systemThread.join();
+	// How long a system took to initialize, in the order the systems were given to the gamestate.
+	std::chrono::nanoseconds getInitializationTime(size_t systemNumber) const {
+		return initializationTimes[systemNumber];
+	}
 
-		std::cout << std::endl << "Systems updated!" << std::endl;
+	// The number of threads that run the systems, besides the one calling update().
+	size_t getNumberOfWorkers() const {
+		return workerPool.getNumberOfWorkers();
 	}
 };
@@ -8,19 +8,45 @@
 template<class S>
 class _SystemDependency {};
 
+// These empty classes list the components that a system reads and writes, as in System<SystemA, Reads<Position>, Writes<Velocity>>.
+// Systems that write a component must be ordered with the rest of the systems that access it.
+template<class... Components>
+class Reads {};
+
+template<class... Components>
+class Writes {};
+
 // Base case.
 template<class... OtherDependencies>
 class _System {
 public:
 	// The base system doesn't depend on anything.
 	class Dependencies {};
+
+	// Nor does it access any component.
+	using ReadComponents = Reads<>;
+	using WriteComponents = Writes<>;
+};
+
+// Case for the components the system reads.
+template<class... Components, class... OtherDependencies>
+class _System<Reads<Components...>, OtherDependencies...> : public _System<OtherDependencies...> {
+public:
+	using ReadComponents = join_components<Reads<Components...>, typename _System<OtherDependencies...>::ReadComponents>;
+};
+
+// Case for the components the system writes.
+template<class... Components, class... OtherDependencies>
+class _System<Writes<Components...>, OtherDependencies...> : public _System<OtherDependencies...> {
+public:
+	using WriteComponents = join_components<Writes<Components...>, typename _System<OtherDependencies...>::WriteComponents>;
 };
 
 // Variadic recursive case.
 template<class D, class... OtherDependencies>
 class _System<D, OtherDependencies...> : public _System<OtherDependencies...> {
 public:
-	_System<D, OtherDependencies...>() {
+	_System() {
 		static_assert(is_system<D>::value, "That is not a system!");
 
 		// Doesn't actually display that message but it triggers a compile error, which is good enough...
@@ -28,14 +54,15 @@ public:
 	}
 
 	// This class inherits all the dependencies this system has.
-	class Dependencies : public _SystemDependency<D>,
-						 public D::Dependencies,
-						 public _System<OtherDependencies...>::Dependencies {};
+	// The bases are virtual, because systems that share a dependency would otherwise reach it twice.
+	class Dependencies : public virtual _SystemDependency<D>,
+						 public virtual D::Dependencies,
+						 public virtual _System<OtherDependencies...>::Dependencies {};
 };
 
 // Interface to the programmer.
 template<class... OtherDependencies>
 class System : public _System<OtherDependencies...> {
 public:
-	class Dependencies : public _System<OtherDependencies...>::Dependencies {};
+	class Dependencies : public virtual _System<OtherDependencies...>::Dependencies {};
 };
@@ -0,0 +1,192 @@
+// Compile time scheduling of the systems of a gamestate.
+
+#pragma once
+
+#include "utils.h"
+
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Whether a system depends on another, for every pair of systems,
+// with systemNumber * NumberOfSystems + dependencyNumber as the index.
+template<class... Systems, size_t... N>
+constexpr std::array<bool, sizeof...(N)> _generateDependencyMatrix(std::index_sequence<N...>) {
+	using SystemTuple = std::tuple<Systems...>;
+	constexpr size_t numberOfSystems = sizeof...(Systems);
+
+	return {{ depends_on<std::tuple_element_t<N / numberOfSystems, SystemTuple>, std::tuple_element_t<N % numberOfSystems, SystemTuple>>::value... }};
+}
+
+// Fails to compile when S1 and S2 access the same component, at least one of them writing it, and neither depends on the other.
+template<class S1, class S2>
+struct _AccessOrderCheck {
+	static constexpr bool value = !conflicts_with<S1, S2>::value || depends_on<S1, S2>::value || depends_on<S2, S1>::value;
+	static_assert(value, "Two systems access the same component and one of them writes it, but neither depends on the other!");
+};
+
+// Checks every pair of systems once.
+template<class... Systems, size_t... N>
+constexpr bool _checkAccessOrder(std::index_sequence<N...>) {
+	using SystemTuple = std::tuple<Systems...>;
+	constexpr size_t numberOfSystems = sizeof...(Systems);
+
+	return (true && ... && std::conditional_t<(N / numberOfSystems < N % numberOfSystems),
+		_AccessOrderCheck<std::tuple_element_t<N / numberOfSystems, SystemTuple>, std::tuple_element_t<N % numberOfSystems, SystemTuple>>,
+		std::true_type>::value);
+}
+
+// The level of every system, which is one more than the highest level among its dependencies.
+template<size_t NumberOfSystems>
+constexpr std::array<size_t, NumberOfSystems> _generateSystemLevels(const std::array<bool, NumberOfSystems * NumberOfSystems>& dependencies) {
+	std::array<size_t, NumberOfSystems> levels{};
+
+	// The longest chain of dependencies has at most as many systems as there are,
+	// so going over all of them that many times is enough for the levels to settle.
+	for (size_t pass = 0; pass < NumberOfSystems; pass++) {
+		for (size_t i = 0; i < NumberOfSystems; i++) {
+			for (size_t j = 0; j < NumberOfSystems; j++) {
+				if (dependencies[i * NumberOfSystems + j] && levels[i] < levels[j] + 1)
+					levels[i] = levels[j] + 1;
+			}
+		}
+	}
+
+	return levels;
+}
+
+template<size_t NumberOfSystems>
+constexpr size_t _countLevels(const std::array<size_t, NumberOfSystems>& levels) {
+	size_t numberOfLevels = 0;
+	for (size_t i = 0; i < NumberOfSystems; i++) {
+		if (levels[i] + 1 > numberOfLevels)
+			numberOfLevels = levels[i] + 1;
+	}
+
+	return numberOfLevels;
+}
+
+// The system numbers sorted by level, keeping the order of the gamestate within a level.
+template<size_t NumberOfSystems>
+constexpr std::array<size_t, NumberOfSystems> _sortSystemsByLevel(const std::array<size_t, NumberOfSystems>& levels) {
+	std::array<size_t, NumberOfSystems> order{};
+	size_t position = 0;
+
+	for (size_t level = 0; position < NumberOfSystems; level++) {
+		for (size_t i = 0; i < NumberOfSystems; i++) {
+			if (levels[i] == level)
+				order[position++] = i;
+		}
+	}
+
+	return order;
+}
+
+// Where every level starts in the sorted systems, followed by the number of systems.
+template<size_t NumberOfLevels, size_t NumberOfSystems>
+constexpr std::array<size_t, NumberOfLevels + 1> _generateLevelStarts(const std::array<size_t, NumberOfSystems>& levels) {
+	std::array<size_t, NumberOfLevels + 1> levelStarts{};
+
+	for (size_t i = 0; i < NumberOfSystems; i++)
+		levelStarts[levels[i] + 1]++;
+
+	for (size_t level = 0; level < NumberOfLevels; level++)
+		levelStarts[level + 1] += levelStarts[level];
+
+	return levelStarts;
+}
+
+// Leaves out the dependencies that some other dependency already depends on, since waiting for that one is enough.
+template<size_t NumberOfSystems>
+constexpr std::array<bool, NumberOfSystems * NumberOfSystems> _removeIndirectDependencies(const std::array<bool, NumberOfSystems * NumberOfSystems>& dependencies) {
+	std::array<bool, NumberOfSystems * NumberOfSystems> directDependencies = dependencies;
+
+	for (size_t i = 0; i < NumberOfSystems; i++) {
+		for (size_t j = 0; j < NumberOfSystems; j++) {
+			for (size_t k = 0; k < NumberOfSystems; k++) {
+				if (dependencies[i * NumberOfSystems + k] && dependencies[k * NumberOfSystems + j])
+					directDependencies[i * NumberOfSystems + j] = false;
+			}
+		}
+	}
+
+	return directDependencies;
+}
+
+// The number of direct dependencies of every system.
+template<size_t NumberOfSystems>
+constexpr std::array<unsigned int, NumberOfSystems> _countDependencies(const std::array<bool, NumberOfSystems * NumberOfSystems>& directDependencies) {
+	std::array<unsigned int, NumberOfSystems> dependencyCounts{};
+
+	for (size_t i = 0; i < NumberOfSystems; i++) {
+		for (size_t j = 0; j < NumberOfSystems; j++) {
+			if (directDependencies[i * NumberOfSystems + j])
+				dependencyCounts[i]++;
+		}
+	}
+
+	return dependencyCounts;
+}
+
+// Where the dependents of every system start in the list of dependents, followed by the length of the list.
+template<size_t NumberOfSystems>
+constexpr std::array<size_t, NumberOfSystems + 1> _generateDependentStarts(const std::array<bool, NumberOfSystems * NumberOfSystems>& directDependencies) {
+	std::array<size_t, NumberOfSystems + 1> dependentStarts{};
+
+	for (size_t j = 0; j < NumberOfSystems; j++) {
+		dependentStarts[j + 1] = dependentStarts[j];
+		for (size_t i = 0; i < NumberOfSystems; i++) {
+			if (directDependencies[i * NumberOfSystems + j])
+				dependentStarts[j + 1]++;
+		}
+	}
+
+	return dependentStarts;
+}
+
+// The systems that directly depend on every system, one system after the other.
+template<size_t NumberOfDependents, size_t NumberOfSystems>
+constexpr std::array<size_t, NumberOfDependents> _generateDependents(const std::array<bool, NumberOfSystems * NumberOfSystems>& directDependencies) {
+	std::array<size_t, NumberOfDependents> dependents{};
+	size_t position = 0;
+
+	for (size_t j = 0; j < NumberOfSystems; j++) {
+		for (size_t i = 0; i < NumberOfSystems; i++) {
+			if (directDependencies[i * NumberOfSystems + j])
+				dependents[position++] = i;
+		}
+	}
+
+	return dependents;
+}
+
+// The static schedule of a gamestate, where the systems are sorted in levels.
+// No system depends on a system of its own level or of a later one, so the systems
+// of a level can all run at the same time once the previous levels finished.
+// It also knows which systems every system has to release when it finishes.
+template<class... Systems>
+struct SystemSchedule {
+	static constexpr size_t numberOfSystems = sizeof...(Systems);
+
+	static constexpr std::array<bool, numberOfSystems * numberOfSystems> dependencies =
+		_generateDependencyMatrix<Systems...>(std::make_index_sequence<numberOfSystems * numberOfSystems>());
+
+	// Whether every pair of systems that would race on a component is ordered.
+	static constexpr bool accessOrdered = _checkAccessOrder<Systems...>(std::make_index_sequence<numberOfSystems * numberOfSystems>());
+
+	static constexpr std::array<size_t, numberOfSystems> levels = _generateSystemLevels<numberOfSystems>(dependencies);
+	static constexpr size_t numberOfLevels = _countLevels<numberOfSystems>(levels);
+
+	static constexpr std::array<size_t, numberOfSystems> order = _sortSystemsByLevel<numberOfSystems>(levels);
+	static constexpr std::array<size_t, numberOfLevels + 1> levelStarts = _generateLevelStarts<numberOfLevels, numberOfSystems>(levels);
+
+	// The dependencies without the ones implied by others, and the other way around, the systems each system releases.
+	static constexpr std::array<bool, numberOfSystems * numberOfSystems> directDependencies = _removeIndirectDependencies<numberOfSystems>(dependencies);
+	static constexpr std::array<unsigned int, numberOfSystems> dependencyCounts = _countDependencies<numberOfSystems>(directDependencies);
+	static constexpr std::array<size_t, numberOfSystems + 1> dependentStarts = _generateDependentStarts<numberOfSystems>(directDependencies);
+	static constexpr std::array<size_t, dependentStarts[numberOfSystems]> dependents = _generateDependents<dependentStarts[numberOfSystems], numberOfSystems>(directDependencies);
+
+	// The systems of the first level, which don't depend on anything.
+	static constexpr size_t numberOfRoots = numberOfLevels > 0 ? levelStarts[1] : 0;
+};
@@ -0,0 +1,98 @@
+// A pool of threads that live as long as the gamestate, so that updating doesn't create threads.
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool final {
+private:
+	std::vector<std::thread> workers;
+
+	// The jobs waiting for a worker, in the order they were pushed.
+	std::deque<std::function<void(void)>> jobs;
+
+	std::mutex jobsMutex;
+	std::condition_variable jobsAvailable;
+
+	// Set when the pool is destroyed, so that the workers stop once the jobs run out.
+	bool stopping = false;
+
+	// What every worker does until the pool is destroyed.
+	void work() {
+		while (true) {
+			std::function<void(void)> job;
+			{
+				std::unique_lock<std::mutex> lock(jobsMutex);
+				jobsAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+
+public:
+	// Starts one worker per hardware thread.
+	WorkerPool() : WorkerPool(std::max(std::thread::hardware_concurrency(), 1u)) {}
+
+	// Starts a given number of workers. With none, the jobs only run when runPendingJob() is called.
+	explicit WorkerPool(size_t numberOfWorkers) {
+		for (size_t i = 0; i < numberOfWorkers; i++)
+			workers.emplace_back(&WorkerPool::work, this);
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Lets the workers finish the pushed jobs and joins them.
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			stopping = true;
+		}
+		jobsAvailable.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	// Queues a job for the next free worker.
+	void push(std::function<void(void)> job) {
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			jobs.push_back(std::move(job));
+		}
+		jobsAvailable.notify_one();
+	}
+
+	// Lets a thread that would otherwise wait run one of the queued jobs.
+	// Returns false if there was none.
+	bool runPendingJob() {
+		std::function<void(void)> job;
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			if (jobs.empty())
+				return false;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+		return true;
+	}
+
+	size_t getNumberOfWorkers() const {
+		return workers.size();
+	}
+};
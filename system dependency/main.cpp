@@ -1,6 +1,5 @@
 // Prototype for the system and gamestate infrastructure, which could help
 // implement parallelism.
-// It requires the BOOST libraries for template magic.
 
 #include "GameState.h"
 #include "System.h"
@@ -18,13 +17,20 @@
 // The number of characters printed on each update cycle.
 #define NUMBER_OF_CHARACTERS 100
 
+// The components the systems work on. Only their types matter to the gamestate.
+struct Position {};
+struct Velocity {};
+struct Health {};
+
 class SystemA;
 class SystemB;
 class SystemC;
 class SystemD;
 class SystemE;
 
-class SystemA : public System<SystemB> {
+// A moves the characters with the velocities that C writes, and D waits for the new positions.
+// E only touches the health, so it runs alongside all of them.
+class SystemA : public System<SystemB, Reads<Velocity>, Writes<Position>> {
 public:
 	void init() {
 		std::cout << "System A was initialized successfully." << std::endl;
@@ -38,7 +44,7 @@ public:
 	}
 };
 
-class SystemB : public System<SystemC> {
+class SystemB : public System<SystemC, Reads<Velocity>> {
 public:
 	void init() {
 		std::cout << "System B was initialized successfully." << std::endl;
@@ -53,7 +59,7 @@ public:
 
 };
 
-class SystemC : public System<> {
+class SystemC : public System<Writes<Velocity>> {
 public:
 	void init() {
 		std::cout << "System C was initialized successfully." << std::endl;
@@ -68,7 +74,7 @@ public:
 
 };
 
-class SystemD : public System<SystemA, SystemB> {
+class SystemD : public System<SystemA, SystemB, Reads<Position>> {
 public:
 	void init() {
 		std::cout << "System D was initialized successfully." << std::endl;
@@ -83,7 +89,7 @@ public:
 
 };
 
-class SystemE : public System<> {
+class SystemE : public System<Writes<Health>> {
 public:
 	void init() {
 		std::cout << "System E was initialized successfully." << std::endl;
@@ -98,6 +104,21 @@ public:
 
 };
 
+// The gamestate only compiles if the systems that would race on a component are ordered.
+static_assert(conflicts_with<SystemD, SystemA>::value && depends_on<SystemD, SystemA>::value, "D must wait for the positions that A writes!");
+static_assert(!conflicts_with<SystemE, SystemA>::value && !conflicts_with<SystemE, SystemD>::value, "E must be able to run alongside A and D!");
+
+#ifdef SHOW_ACCESS_CONFLICT
+// Build with SHOW_ACCESS_CONFLICT defined to see the error: F writes the positions that D reads, but neither waits for the other.
+class SystemF : public System<Writes<Position>> {
+public:
+	void init() {}
+	void update(unsigned int) {}
+};
+
+static_assert(SystemSchedule<SystemD, SystemF>::accessOrdered, "F and D must be ordered!");
+#endif
+
 int main() {
 	GameState<SystemA, SystemB, SystemC, SystemD, SystemE> gs;
 	gs.init();
@@ -4,7 +4,7 @@
 
 #include "System.h"
 
-#include <boost/type_traits.hpp>
+#include <type_traits>
 
 template<class S>
 class _SystemDependency;
@@ -12,6 +12,12 @@ class _SystemDependency;
 template<class... OtherDependencies>
 class _System;
 
+template<class... Components>
+class Reads;
+
+template<class... Components>
+class Writes;
+
 // Checks if T is a system.
 template <class T>
 using is_system = std::is_base_of<_System<>, T>;
@@ -19,3 +25,36 @@ using is_system = std::is_base_of<_System<>, T>;
 // Checks if S1 depends on S2.
 template <class S1, class S2>
 using depends_on = std::is_base_of<_SystemDependency<S2>, typename S1::Dependencies>;
+
+// Joins two lists of components of the same kind.
+template <class L1, class L2>
+struct _joinComponents;
+
+template <template<class...> class List, class... Components1, class... Components2>
+struct _joinComponents<List<Components1...>, List<Components2...>> {
+	using type = List<Components1..., Components2...>;
+};
+
+template <class L1, class L2>
+using join_components = typename _joinComponents<L1, L2>::type;
+
+// Checks if a list of components has the component C.
+template <class C, class List>
+struct has_component;
+
+template <class C, template<class...> class List, class... Components>
+struct has_component<C, List<Components...>> : std::disjunction<std::is_same<C, Components>...> {};
+
+// Checks if two lists of components have any component in common.
+template <class L1, class L2>
+struct shares_component;
+
+template <template<class...> class List, class... Components, class L2>
+struct shares_component<List<Components...>, L2> : std::disjunction<has_component<Components, L2>...> {};
+
+// Checks if S1 and S2 can't run at the same time, because one of them writes a component that the other one accesses.
+template <class S1, class S2>
+using conflicts_with = std::bool_constant<
+	shares_component<typename S1::WriteComponents, typename S2::WriteComponents>::value ||
+	shares_component<typename S1::WriteComponents, typename S2::ReadComponents>::value ||
+	shares_component<typename S1::ReadComponents, typename S2::WriteComponents>::value>;